@@ -0,0 +1,309 @@
+/*
+ * prgi: overhead benchmarks.
+ *
+ * Copyright (C) 2023  Joao Luis Meloni Assirati.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * This program measures the overhead of prgi in nanoseconds per call:
+ *
+ * - baseline: a loop with the same structure as the ones below, but
+ *   without prgi.
+ * - fast: prgi_update(1) in a loop, mostly taking the inline path.
+ * - slow: prgi_update__() called directly, which is the cost paid
+ *   each time a thread crosses its mark.
+ * - fast_mt and slow_mt: same as fast and slow, with the calls split
+ *   among 1, 2, 4, ... threads. The time per call is the total thread
+ *   time (wall time times the number of threads) divided by the
+ *   number of calls, so it is constant with no contention.
+ * - adjacent_mt: like fast_mt, but each call also writes hot
+ *   thread-local data of the program, which is likely placed next to
+ *   the thread state of prgi, while a reporter thread (see
+ *   prgi.reporter) reads the counters of the threads. This shows the
+ *   effect of keeping the thread state in its own cache lines, which
+ *   can be compared with bench_overhead_packed, compiled with a
+ *   PRGI_CACHELINE of 8 bytes (no padding).
+ *
+ * The benchmarks run for several values of prgi.update. Nothing is
+ * printed by prgi (prgi.output is /dev/null). Results are written to
+ * stdout as CSV, or as JSON lines (one object per result) with option
+ * -j, to be compared across versions of prgi. "make bench" runs this
+ * program compiled with and without PRGI_UPDATE_MACRO (and packed,
+ * with PRGI_TICK and as C++, where fast uses prgi::tracker of
+ * prgi.hpp) and writes bench.csv and bench.jsonl.
+ *
+ * Usage: bench_overhead [-j] [-h] [-n calls] [-s slow calls] [-t max threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <threads.h>
+
+#ifdef __cplusplus
+/* prgi.hpp hides the macro prgi. */
+#include "prgi.hpp"
+#define cfg (prgi::config())
+#else
+#include "prgi.h"
+#define cfg prgi
+#endif
+
+#if defined(__cplusplus)
+#define BUILD "cpp"
+#elif defined(PRGI_UPDATE_MACRO)
+#define BUILD "macro"
+#elif PRGI_CACHELINE < 64
+#define BUILD "packed"
+#elif defined(PRGI_TICK)
+#define BUILD "tick"
+#else
+#define BUILD "inline"
+#endif
+
+/* Update periods to be benchmarked. */
+static float const periods[] = {0.2, 0.02, 0.002};
+#define NPERIODS (sizeof(periods) / sizeof(periods[0]))
+
+/* Command line options. */
+static long int ncalls = 100000000;
+static long int nslow = 1000000;
+static int maxthreads;
+static bool json;
+
+/* Prevents the compiler from optimizing the loops away. */
+static volatile long int sink;
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1E-9 * t.tv_nsec;
+}
+
+/* The CSV header is omitted with option -j. */
+static void print_header(void) {
+    if(!json) printf("build,benchmark,threads,update,calls,ns_per_call\n");
+}
+
+static void print_result(char const *bench, int threads, float update,
+                         long int calls, double ns) {
+    if(json) {
+        printf("{\"build\": \"%s\", \"benchmark\": \"%s\", "
+               "\"threads\": %d, \"update\": %g, \"calls\": %ld, "
+               "\"ns_per_call\": %.3f}\n",
+               BUILD, bench, threads, update, calls, ns);
+    } else {
+        printf("%s,%s,%d,%g,%ld,%.3f\n", BUILD, bench, threads, update,
+               calls, ns);
+    }
+    fflush(stdout);
+}
+
+
+/*** Loops run by the benchmarks **********************************************/
+
+/* The loops start at a cache line. Otherwise their timing depends on
+   the size of the code before them (even on the number of functions
+   imported from prgi.c), which can change the results of fast by 2x
+   on some processors, whatever the version of prgi. */
+#define LOOP_ALIGN __attribute__ ((aligned(64)))
+
+LOOP_ALIGN static void loop_baseline(long int n) {
+    long int s = 0;
+    for(long int i = 0; i < n; i++) {
+        /* The empty asm keeps the loop from being vectorized or
+           removed, as prgi_update() does. */
+        __asm__ volatile("");
+        s++;
+    }
+    sink = s;
+}
+
+#ifndef __cplusplus
+LOOP_ALIGN static void loop_fast(long int n) {
+    long int s = 0;
+    for(long int i = 0; i < n; i++) {
+        if(prgi_update(1)) s++;
+    }
+    sink = s;
+}
+#else
+/* The C++ build measures prgi::tracker instead of prgi_update(). */
+LOOP_ALIGN static void loop_fast(long int n) {
+    prgi::tracker<> t;
+    long int s = 0;
+    for(long int i = 0; i < n; i++) {
+        if(t.update(1)) s++;
+    }
+    sink = s;
+}
+#endif
+
+/* Hot thread-local data of the program. */
+static thread_local long int hot[4];
+
+LOOP_ALIGN static void loop_adjacent(long int n) {
+    long int s = 0;
+    for(long int i = 0; i < n; i++) {
+        hot[i & 3] += i;
+        if(prgi_update(1)) s++;
+    }
+    sink = s + hot[0];
+}
+
+LOOP_ALIGN static void loop_slow(long int n) {
+    long int s = 0;
+    for(long int i = 0; i < n; i++) {
+        prgi_thread_.count++;
+        if(prgi_update__()) s++;
+    }
+    sink = s;
+}
+
+/********************************************** Loops run by the benchmarks ***/
+
+
+/*** Multi-threaded runs ******************************************************/
+
+struct job {
+    void (*loop)(long int n);
+    long int n;
+};
+
+static void *run_job(void *data) {
+    struct job *job = (struct job *)data;
+    prgi_init_thread(job->n);
+    job->loop(job->n);
+    return NULL;
+}
+
+/* Runs loop with n calls split among nthreads threads. Returns the
+   wall time. */
+static double run_threads(void (*loop)(long int), long int n, int nthreads) {
+    pthread_t threads[nthreads];
+    struct job jobs[nthreads];
+    double t;
+
+    prgi_init(0);
+
+    t = now();
+    for(int i = 0; i < nthreads; i++) {
+        jobs[i].loop = loop;
+        jobs[i].n = n / nthreads;
+        if(pthread_create(&threads[i], NULL, run_job, &jobs[i])) {
+            fprintf(stderr, "Thread creation failed\n");
+            exit(1);
+        }
+    }
+    for(int i = 0; i < nthreads; i++) pthread_join(threads[i], NULL);
+
+    return now() - t;
+}
+
+/* Reporter that prints nothing, so that only the sampling of the
+   thread counters is measured. */
+static void reporter(void) {
+}
+
+/* Like run_threads(), with the reporter thread. */
+static double run_reporting(void (*loop)(long int), long int n,
+                            int nthreads) {
+    double t;
+
+    cfg.reporter = reporter;
+    t = run_threads(loop, n, nthreads);
+    prgi_done();
+    cfg.reporter = NULL;
+
+    return t;
+}
+
+/****************************************************** Multi-threaded runs ***/
+
+
+/* Number of threads to be benchmarked after t: 1, 2, 4, ... and
+   maxthreads. */
+static int next_nthreads(int t) {
+    if(t == maxthreads) return t + 1;
+    return 2 * t < maxthreads ? 2 * t : maxthreads;
+}
+
+/* Runs loop with n calls in the calling thread. Returns the wall time. */
+static double run(void (*loop)(long int), long int n) {
+    double t;
+
+    prgi_init(n);
+
+    t = now();
+    loop(n);
+    return now() - t;
+}
+
+static void usage(char const *name) {
+    fprintf(stderr, "Usage: %s [-j] [-h] [-n calls] [-s slow calls] "
+            "[-t max threads]\n", name);
+}
+
+int main(int argc, char **argv) {
+    int opt;
+
+    maxthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    while((opt = getopt(argc, argv, "jhn:s:t:")) != -1) {
+        switch(opt) {
+        case 'j': json = true; break;
+        case 'n': ncalls = atol(optarg); break;
+        case 's': nslow = atol(optarg); break;
+        case 't': maxthreads = atoi(optarg); break;
+        default: usage(argv[0]); return opt != 'h';
+        }
+    }
+    if(maxthreads < 1) maxthreads = 1;
+
+    cfg.output = fopen("/dev/null", "w");
+    if(!cfg.output) {
+        perror("/dev/null");
+        return 1;
+    }
+
+    print_header();
+
+    print_result("baseline", 1, 0, ncalls,
+                 1E9 * run(loop_baseline, ncalls) / ncalls);
+
+    for(unsigned int p = 0; p < NPERIODS; p++) {
+        cfg.update = periods[p];
+
+        print_result("fast", 1, cfg.update, ncalls,
+                     1E9 * run(loop_fast, ncalls) / ncalls);
+        print_result("slow", 1, cfg.update, nslow,
+                     1E9 * run(loop_slow, nslow) / nslow);
+
+        for(int t = 1; t <= maxthreads; t = next_nthreads(t)) {
+            print_result("fast_mt", t, cfg.update, ncalls,
+                         1E9 * t * run_threads(loop_fast, ncalls, t) / ncalls);
+            print_result("slow_mt", t, cfg.update, nslow,
+                         1E9 * t * run_threads(loop_slow, nslow, t) / nslow);
+            print_result("adjacent_mt", t, cfg.update, ncalls,
+                         1E9 * t * run_reporting(loop_adjacent, ncalls, t) /
+                         ncalls);
+        }
+    }
+
+    return 0;
+}
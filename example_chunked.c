@@ -0,0 +1,71 @@
+/*
+ * prgi: example_chunked.c
+ *
+ * Copyright (C) 2023  Joao Luis Meloni Assirati.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * In this example, the terms of the sum are computed by an inner loop
+ * without calls to prgi, so that the compiler is free to optimize it
+ * (it can be vectorized with -O3 -ffast-math, for example). The
+ * outer loop (PRGI_FOR_CHUNKED) calls prgi_update() once per chunk
+ * (see prgi_chunk() in prgi.h). To keep the inner loop simple, the
+ * sum is done without Kahan compensation, so the result is less
+ * accurate than in example_tutorial.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "prgi.h"
+
+int main(int argc, char **argv) {
+    long int N;
+    float s;
+
+    N = 4000000000l;
+    if(argc > 1) N = atol(argv[1]);
+    printf("Summing %ld terms\n", N);
+    printf("Run %s <Number of terms> to change the number of terms.\n\n",
+           argv[0]);
+
+    prgi_init(N);
+
+    s = 0;
+    PRGI_FOR_CHUNKED(n0, n1, N, 1 << 16) {
+        /* The chunk is summed from the last term to the first for
+           better accuracy. */
+        float c = 0;
+        for(long int n = n1; n > n0; n--) {
+            float f = n;
+            c += 1 / (f*f);
+        }
+        s += c;
+
+        if(prgi_update(n1 - n0)) {
+            prgi_printf("%s [%s] Remaining: %s, Speed: %s terms/s",
+                        prgi_percent(), prgi_bar(0, "#."),
+                        prgi_remaining(), prgi_rate());
+        }
+    }
+
+    prgi_printf("Elapsed time: %s, Mean speed: %s terms/s",
+                prgi_elapsed(), prgi_mean_rate());
+
+    printf("\npi = %.6f\n", sqrt(6*s));
+
+    return 0;
+}
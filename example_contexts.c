@@ -0,0 +1,98 @@
+/*
+ * prgi: example program.
+ *
+ * Copyright (C) 2023  Joao Luis Meloni Assirati.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * This example runs two independent workloads, each with its own
+ * prgi context (see prgi_ctx_new() in prgi.h). The main thread sums
+ * a series in the default context and prints its progress. A
+ * background thread, standing for a library with its own progress
+ * reporting, sums another series in a second context that exports
+ * its progress to prgi-top instead of printing it, so that the two
+ * never share a lock, a counter or the output.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include "prgi.h"
+
+static prgi_ctx_t *lib_ctx;
+static long int M;
+
+/* The "library": sums 1/n^4 with its own context. */
+static void *library(void *arg) {
+    double *s = arg, c = 0;
+
+    prgi_ctx_use(lib_ctx);
+    prgi.shm_export = true;
+    prgi_init(M);
+    for(long int n = 1; n <= M; n++) {
+        double f = n, x = 1.0 / (f*f*f*f), y = x + c, t = *s + y;
+        c = y - (t - *s);
+        *s = t;
+        /* Nothing to print: the progress is seen in prgi-top. */
+        prgi_update(1);
+    }
+    prgi_done();
+
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    long int N = 2000000000l;
+    double s = 0, c = 0, s4 = 0;
+    pthread_t t;
+
+    if(argc > 1) N = atol(argv[1]);
+    M = N / 2;
+    printf("Run prgi-top in another terminal to see the library progress.\n\n");
+
+    lib_ctx = prgi_ctx_new();
+    if(!lib_ctx || pthread_create(&t, NULL, library, &s4)) return 1;
+
+    /* The default context. */
+    prgi_init(N);
+    for(long int n = 1; n <= N; n++) {
+        double f = n, x = 1.0 / (f*f), y = x + c, t = s + y;
+        c = y - (t - s);
+        s = t;
+
+        if(prgi_update(1))
+            prgi_printf("Main: [%s] %s Remaining: %s, Speed: %s terms/s",
+                        prgi_bar(0, "#."), prgi_percent(),
+                        prgi_remaining(), prgi_rate());
+    }
+    prgi_done();
+    prgi_printf("Main: Elapsed time: %s, Mean speed: %s terms/s",
+                prgi_elapsed(), prgi_mean_rate());
+
+    pthread_join(t, NULL);
+
+    /* The status fields of the library are in its context. */
+    prgi_ctx_use(lib_ctx);
+    printf("\nLibrary: Elapsed time: %s, Mean speed: %s terms/s\n",
+           prgi_elapsed(), prgi_mean_rate());
+    prgi_ctx_use(NULL);
+    prgi_ctx_free(lib_ctx);
+
+    printf("\npi = %.14f, pi = %.14f\n\n", sqrt(6*s), sqrt(sqrt(90*s4)));
+
+    return 0;
+}
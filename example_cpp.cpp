@@ -0,0 +1,65 @@
+/*
+ * prgi: example program.
+ *
+ * Copyright (C) 2023  Joao Luis Meloni Assirati.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * C++ version of example_tutorial.c, using prgi.hpp: prgi::scope
+ * initializes the task and prgi::tracker counts the summed terms,
+ * printing the progress line with prgi::line_sink.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#include "prgi.hpp"
+
+int main(int argc, char **argv) {
+    long int N;
+    double s = 0, c = 0;
+
+    N = 4000000000l;
+    if(argc > 1) N = atol(argv[1]);
+    printf("Summing %ld terms\n", N);
+    printf("Run %s <Number of terms> to change the number of terms.\n\n",
+           argv[0]);
+
+    prgi::config().update = 0.1;
+
+    {
+        /* The tracker is destroyed before the scope, so its work is
+           accounted by prgi_done(). */
+        prgi::scope task(N);
+        prgi::tracker<long int, prgi::line_sink> terms;
+
+        for(long int n = 1; n <= N; n++) {
+            double f = n, x = 1.0 / (f*f), y = x + c, t = s + y;
+            c = y - (t - s);
+            s = t;
+
+            terms.update(1);
+        }
+    }
+
+    prgi_printf("Elapsed time: %s, Mean speed: %s terms/s",
+                prgi_elapsed(), prgi_mean_rate());
+
+    printf("\npi = %.14f\n\n", sqrt(6*s));
+
+    return 0;
+}
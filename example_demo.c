@@ -199,5 +199,21 @@ int main(int argc, char **argv) {
     sleep(2);
     printf("\n\n");
 
+
+    printf("Example 11: Unicode blocks (needs an UTF-8 terminal).\n");
+    prgi_init(N);
+    for(k = 0; k < N; k++) {
+        if(prgi_update(1)) {
+            prgi_printf("%s %c |%s| Remaining: %s, Speed: %s counts/s",
+                        prgi_percent(), prgi_throbber("|/-\\"),
+                        prgi_bar(0, PRGI_BLOCKS), prgi_remaining(),
+                        prgi_rate());
+        }
+    }
+    prgi_printf("Elapsed: %s, Mean speed: %s counts/s",
+                prgi_elapsed(), prgi_mean_rate());
+    sleep(2);
+    printf("\n\n");
+
     return 0;
 }
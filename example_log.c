@@ -0,0 +1,91 @@
+/*
+ * prgi: example program.
+ *
+ * Copyright (C) 2023  Joao Luis Meloni Assirati.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * This example sums a series with 4 threads, each one logging a
+ * message with prgi_log() (see prgi.h) each time it finishes a tenth
+ * of its work. The messages scroll above the progress line without
+ * disturbing it, and logging never blocks the threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include "prgi.h"
+
+#define NTHREADS 4
+
+static long int N;
+static double sums[NTHREADS];
+static int ids[NTHREADS];
+
+static void *worker(void *arg) {
+    int id = *(int *)arg;
+    long int n0 = id * (N / NTHREADS) + 1, n1 = (id + 1) * (N / NTHREADS);
+    long int tenth = (n1 - n0 + 1) / 10;
+    double s = 0, c = 0;
+
+    prgi_init_thread(n1 - n0 + 1);
+    for(long int n = n0; n <= n1; n++) {
+        double f = n, x = 1.0 / (f*f), y = x + c, t = s + y;
+        c = y - (t - s);
+        s = t;
+
+        if((n - n0 + 1) % tenth == 0)
+            prgi_log("Thread %d: %ld%% done, partial sum %.14f", id,
+                     10 * (n - n0 + 1) / tenth, s);
+
+        if(prgi_update(1))
+            prgi_printf("%s [%s] Remaining: %s, Speed: %s terms/s",
+                        prgi_percent(), prgi_bar(0, "#."),
+                        prgi_remaining(), prgi_rate());
+    }
+    sums[id] = s;
+
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    pthread_t t[NTHREADS];
+    double s = 0;
+
+    N = 2000000000l;
+    if(argc > 1) N = atol(argv[1]);
+
+    prgi_init(0);
+    for(int i = 0; i < NTHREADS; i++) {
+        ids[i] = i;
+        if(pthread_create(&t[i], NULL, worker, &ids[i])) {
+            fprintf(stderr, "Could not create thread\n");
+            return 1;
+        }
+    }
+    for(int i = 0; i < NTHREADS; i++) pthread_join(t[i], NULL);
+
+    /* The last messages are printed here. */
+    prgi_done();
+    prgi_printf("Elapsed: %s, Mean speed: %s terms/s",
+                prgi_elapsed(), prgi_mean_rate());
+
+    for(int i = 0; i < NTHREADS; i++) s += sums[i];
+    printf("\npi = %.14f\n\n", sqrt(6*s));
+
+    return 0;
+}
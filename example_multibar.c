@@ -0,0 +1,100 @@
+/*
+ * prgi: example_multibar.c
+ *
+ * Copyright (C) 2023  Joao Luis Meloni Assirati.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "prgi.h"
+
+/*
+ * Multi-threaded sum with one progress line per thread (see
+ * prgi_multibar()). The work is divided in equal parts, but thread i
+ * sums each term i + 1 times, so the last threads are slower and
+ * can be spotted in the display. With more threads than
+ * prgi.multibar, only the slowest threads are shown.
+ */
+
+#define NTHREADS 6
+
+/* Number of terms of the sum */
+long int N;
+/* Results of sums in each thread. */
+double s[NTHREADS];
+
+void *sum(void *data) {
+    int i = (long int)data;
+    long int n0 = i * (N / NTHREADS) + 1;
+    long int n1 = i == NTHREADS - 1 ? N : (i + 1) * (N / NTHREADS);
+    double r = 0;
+
+    prgi_init_thread(n1 - n0 + 1);
+
+    for(long int n = n0; n <= n1; n++) {
+        /* Repeat the work to make the thread slower. */
+        for(int k = 0; k <= i; k++) {
+            double f = n + k * 1E-20;
+            r += 1.0 / (f*f);
+        }
+
+        if(prgi_update(1)) {
+            prgi_printf("Total: %s [%s] Remaining: %s", prgi_percent(),
+                        prgi_bar(0, "#."), prgi_remaining());
+            prgi_multibar();
+        }
+    }
+
+    s[i] = r / (i + 1);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    pthread_t t[NTHREADS];
+    double r = 0;
+
+    N = 1000000000l;
+    if(argc > 1) N = atol(argv[1]);
+    printf("Summing %ld terms\n", N);
+    printf("Run %s <Number of terms> to change the number of terms.\n\n",
+           argv[0]);
+
+    /* At most 5 lines for the threads. */
+    prgi.multibar = 5;
+    prgi_init(0);
+
+    for(long int i = 0; i < NTHREADS; i++) {
+        if(pthread_create(&t[i], NULL, sum, (void *)i)) {
+            printf("Thread creation failed\n");
+            exit(1);
+        }
+    }
+
+    for(int i = 0; i < NTHREADS; i++) {
+        pthread_join(t[i], NULL);
+        r += s[i];
+    }
+
+    prgi_printf("Elapsed: %s, Mean speed: %s terms/s",
+                prgi_elapsed(), prgi_mean_rate());
+
+    printf("\npi = %.14f\n", sqrt(6*r));
+
+    return 0;
+}
@@ -55,6 +55,10 @@ int main(int argc, char **argv) {
                         prgi_percent(), prgi_throbber("|/-\\"));
             prgi_printf("Remaining: %s, Speed: %s terms/s",
                         prgi_remaining(), prgi_rate());
+            /* Smoothed estimates, averaged over the last
+               prgi.rate_window updates. */
+            prgi_printf("Smoothed remaining: %s, Smoothed speed: %s terms/s",
+                        prgi_remaining_smoothed(), prgi_rate_smoothed());
         }
     }
     prgi_printf("Elapsed time: %s, Mean speed: %s terms/s",
@@ -0,0 +1,83 @@
+/*
+ * prgi: example_openmp.c
+ *
+ * Copyright (C) 2023  Joao Luis Meloni Assirati.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "prgi.h"
+
+/*
+ * OpenMP version of example_tutorial.c.
+ *
+ * With prgi.lazy_threads, the OpenMP threads attach themselves to
+ * prgi at their first call of prgi_update(), so prgi_init_thread() is
+ * not needed and the work of each thread doesn't have to be known in
+ * advance. This allows dynamic schedules. The sum is done twice to
+ * show that the threads, which are reused by OpenMP, attach again to
+ * the second task.
+ */
+
+double sum(long int N) {
+    double s = 0;
+
+    /* The whole work is given to prgi_init(). */
+    prgi_init(N);
+
+    #pragma omp parallel for schedule(dynamic, 100000) reduction(+:s)
+    for(long int n = 1; n <= N; n++) {
+        double f = n;
+        s += 1.0 / (f*f);
+
+        /* Account for 1 summed term in the thread */
+        if(prgi_update(1)) {
+            prgi_printf("%s %c [%s] Remaining: %s, Speed: %s terms/s)",
+                        prgi_percent(), prgi_throbber("|/-\\"),
+                        prgi_bar(0, "#."), prgi_remaining(), prgi_rate());
+        }
+    }
+
+    /* Account for the work done by all threads and show 100%. */
+    prgi_done();
+    prgi_printf("%s Elapsed: %s, Mean speed: %s terms/s",
+                prgi_percent(), prgi_elapsed(), prgi_mean_rate());
+    printf("\n");
+
+    return s;
+}
+
+int main(int argc, char **argv) {
+    long int N;
+
+    N = 4000000000l;
+    if(argc > 1) N = atol(argv[1]);
+    printf("Summing %ld terms\n", N);
+    printf("Run %s <Number of terms> to change the number of terms.\n\n",
+           argv[0]);
+
+    prgi.lazy_threads = true;
+
+    printf("First run\n");
+    printf("pi = %.14f\n\n", sqrt(6*sum(N)));
+
+    printf("Second run\n");
+    printf("pi = %.14f\n", sqrt(6*sum(N)));
+
+    return 0;
+}
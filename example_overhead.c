@@ -96,6 +96,20 @@ int main(int argc, char **argv) {
     run_prgi(N);
     t_prgi = prgi.elapsed; /* Save the elapsed time. */
 
+#ifdef PRGI_STATS
+    {
+        /* Internal counters, available when compiled with PRGI_STATS
+           (see example_overhead_stats in the Makefile). */
+        struct prgi_stats st;
+        prgi_stats(&st);
+        printf("Slow calls: %ld (%ld returned true), status updates: %ld\n"
+               "Lock wait: %.6fs, lock hold: %.6fs, I/O: %.6fs in %ld writes\n"
+               "Update period: %.3fs requested, %.3fs achieved\n\n",
+               st.slow_calls, st.updates, st.status_updates, st.lock_wait,
+               st.lock_hold, st.io_time, st.io_writes, st.update, st.period);
+    }
+#endif
+
     run_plain(N);
     t_plain = prgi.elapsed;
 
@@ -0,0 +1,117 @@
+/*
+ * prgi: example program.
+ *
+ * Copyright (C) 2023  Joao Luis Meloni Assirati.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "prgi.h"
+
+/*
+ * A pool of long-lived worker threads running many short jobs, each
+ * one summing a slice of terms of example_threads.c. The workers call
+ * prgi_thread_attach() and prgi_thread_detach() around each job, so
+ * the progress is accurate when a job ends and the jobs never
+ * serialize on the lock of prgi.
+ */
+
+#define NWORKERS 4
+
+/* Number of jobs and terms per job. */
+long int njobs, nterms;
+/* Next job to be taken and number of jobs done. */
+atomic_long next_job, jobs_done;
+/* Results of sums in each worker. */
+double sums[NWORKERS];
+
+
+/* Sums the terms of job j. */
+double job(long int j) {
+    double s = 0, c = 0;
+
+    /* The total work grows with the jobs taken. */
+    prgi_thread_attach(nterms);
+
+    for(long int n = j * nterms + 1; n <= (j + 1) * nterms; n++) {
+        double f = n, x = 1.0 / (f*f), y = x + c, t = s + y;
+        c = y - (t - s);
+        s = t;
+
+        if(prgi_update(1)) {
+            prgi_printf("%c Jobs: %ld/%ld, Speed: %s terms/s, Elapsed: %s",
+                        prgi_throbber("|/-\\"), atomic_load(&jobs_done),
+                        njobs, prgi_rate(), prgi_elapsed());
+        }
+    }
+
+    /* Accounts for the terms summed since the last update. */
+    prgi_thread_detach();
+    atomic_fetch_add(&jobs_done, 1);
+
+    return s;
+}
+
+void *worker(void *data) {
+    double *sum = data;
+    long int j;
+
+    while((j = atomic_fetch_add(&next_job, 1)) < njobs) *sum += job(j);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    pthread_t workers[NWORKERS];
+    double s;
+
+    njobs = 100000;
+    nterms = 20000;
+    if(argc > 1) njobs = atol(argv[1]);
+    if(argc > 2) nterms = atol(argv[2]);
+    printf("Running %ld jobs of %ld terms in %d workers\n",
+           njobs, nterms, NWORKERS);
+    printf("Run %s <Number of jobs> <Terms per job> to change them.\n\n",
+           argv[0]);
+
+    /* The jobs add their work as the workers take them. */
+    prgi_init(0);
+
+    for(int i = 0; i < NWORKERS; i++) {
+        if(pthread_create(&workers[i], NULL, worker, &sums[i])) {
+            printf("Thread creation failed\n");
+            exit(1);
+        }
+    }
+
+    s = 0;
+    for(int i = 0; i < NWORKERS; i++) {
+        pthread_join(workers[i], NULL);
+        s += sums[i];
+    }
+
+    prgi_done();
+    prgi_printf("Jobs: %ld, Terms: %ld, Elapsed: %s, Mean speed: %s terms/s",
+                atomic_load(&jobs_done), njobs * nterms,
+                prgi_elapsed(), prgi_mean_rate());
+
+    printf("\npi = %.14f\n\n", sqrt(6*s));
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * prgi: example program.
+ *
+ * Copyright (C) 2023  Joao Luis Meloni Assirati.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * This example sums a series with a slowdown in the middle of the
+ * run and then prints the throughput profile with prgi_report() (see
+ * prgi.h), which shows the slowdown hidden by the mean rate. Run
+ * with -csv to print the profile as CSV instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "prgi.h"
+
+int main(int argc, char **argv) {
+    bool csv = argc > 1 && strcmp(argv[1], "-csv") == 0;
+    long int N = 1000000000l;
+    double s = 0, c = 0;
+
+    prgi_init(N);
+
+    for(long int n = 1; n <= N; n++) {
+        double f = n, x = 1.0 / (f*f), y = x + c, t = s + y;
+        c = y - (t - s);
+        s = t;
+
+        /* Simulate a slower period, from 40% to 50% of the work. */
+        if(n > 4 * N / 10 && n <= 5 * N / 10)
+            for(int k = 0; k < 4; k++) s += sqrt(x + k) * 1E-30;
+
+        if(prgi_update(1))
+            prgi_printf("[%s] %s Remaining: %s, Speed: %s terms/s",
+                        prgi_bar(0, "#."), prgi_percent(),
+                        prgi_remaining(), prgi_rate());
+    }
+
+    prgi_done();
+    prgi_printf("Elapsed time: %s, Mean speed: %s terms/s",
+                prgi_elapsed(), prgi_mean_rate());
+    printf("\n");
+
+    if(csv) {
+        prgi_report_csv(stdout);
+    } else {
+        prgi_report(stdout);
+    }
+
+    printf("\ns = %.14f\n\n", s);
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * prgi: example_ranks.c
+ *
+ * Copyright (C) 2023  Joao Luis Meloni Assirati.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "prgi.h"
+
+/*
+ * Multi-process version of example_tutorial.c, showing the
+ * aggregation of ranks (see prgi.aggregate). Each of NRANKS processes
+ * sums a part of the terms, as MPI ranks would do. Rank 0 prints
+ * the global progress with the reporter thread while the other ranks
+ * send their counters to it. With MPI, prgi.rank would be set with
+ * MPI_Comm_rank() and the host in prgi.aggregate would be the host of
+ * rank 0.
+ */
+
+#define NRANKS 4
+
+/* Rank 0 prints the aggregated progress. */
+void reporter(void) {
+    prgi_printf("%s [%s] Remaining: %s, Speed: %s terms/s",
+                prgi_percent(), prgi_bar(0, "#."), prgi_remaining(),
+                prgi_rate());
+}
+
+int main(int argc, char **argv) {
+    long int N, n0, n1;
+    double s, c;
+    int rank;
+
+    N = 4000000000l;
+    if(argc > 1) N = atol(argv[1]);
+    printf("Summing %ld terms\n", N);
+    printf("Run %s <Number of terms> to change the number of terms.\n\n",
+           argv[0]);
+    fflush(stdout);
+
+    /* Fork the ranks 1, 2, ..., NRANKS - 1. */
+    for(rank = NRANKS - 1; rank > 0; rank--)
+        if(fork() == 0) break;
+
+    n0 = rank * (N / NRANKS) + 1;
+    n1 = rank == NRANKS - 1 ? N : (rank + 1) * (N / NRANKS);
+
+    prgi.aggregate = "127.0.0.1:7493";
+    prgi.rank = rank;
+    prgi.reporter = reporter;
+    prgi_init(n1 - n0 + 1);
+
+    s = 0;
+    c = 0;
+    for(long int n = n0; n <= n1; n++) {
+        double f = n, x = 1.0 / (f*f), y = x + c, t = s + y;
+        c = y - (t - s);
+        s = t;
+
+        /* Only sends the counters in ranks other than 0. */
+        prgi_update(1);
+    }
+
+    if(rank != 0) {
+        /* Send the final counters. The partial sums would be
+           collected by MPI_Reduce() in a MPI program. */
+        prgi_done();
+        return 0;
+    }
+
+    /* Wait for the other ranks and show the final state. */
+    while(wait(NULL) > 0);
+    prgi_done();
+    prgi_printf("Elapsed: %s, Mean speed: %s terms/s",
+                prgi_elapsed(), prgi_mean_rate());
+    printf("\n");
+
+    return 0;
+}
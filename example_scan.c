@@ -0,0 +1,96 @@
+/*
+ * prgi: example program.
+ *
+ * Copyright (C) 2023  Joao Luis Meloni Assirati.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * This example computes a checksum of a file twice: reading it with
+ * prgi_read() and scanning a mapping of it with prgi_update_pos()
+ * (see "I/O loops" in prgi.h). The progress is counted in bytes. If
+ * no file is given, a sparse temporary file is used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "prgi.h"
+
+/* Size of the temporary file */
+#define TMPSIZE (2048l << 20)
+
+/* Called by prgi_read() when it is time to print. */
+static void show(void) {
+    prgi_printf("Reading: [%s] %s %s", prgi_bar(0, "#."), prgi_percent(),
+                prgi_byte_rate());
+}
+
+int main(int argc, char **argv) {
+    static unsigned char buf[1 << 16];
+    uint64_t sum = 0;
+    unsigned char *map;
+    ssize_t n;
+    off_t size;
+    int fd;
+
+    if(argc > 1) {
+        fd = open(argv[1], O_RDONLY);
+    } else {
+        FILE *f = tmpfile();
+        fd = f && ftruncate(fileno(f), TMPSIZE) == 0 ? dup(fileno(f)) : -1;
+        printf("Run %s <file> to scan a file.\n\n", argv[0]);
+    }
+    if(fd < 0) {
+        perror("open");
+        return 1;
+    }
+
+    /* The total is the size of the file. */
+    prgi.io_print = show;
+    prgi_init_fd(fd);
+    while((n = prgi_read(fd, buf, sizeof(buf))) > 0)
+        for(ssize_t i = 0; i < n; i++) sum += buf[i];
+    prgi_done();
+    prgi_printf("Mean speed: %s", prgi_byte_mean_rate());
+    printf("\nChecksum: %llu\n\n", (unsigned long long)sum);
+
+    /* Scan the mapping, without reading it again to report progress. */
+    size = lseek(fd, 0, SEEK_END);
+    map = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    if(map == NULL || map == MAP_FAILED) return 0;
+
+    sum = 0;
+    lseek(fd, 0, SEEK_SET);
+    prgi_init_fd(fd);
+    for(off_t pos = 0; pos < size; pos += sizeof(buf)) {
+        off_t end = pos + (off_t)sizeof(buf) < size ? pos + sizeof(buf) : size;
+        for(off_t i = pos; i < end; i++) sum += map[i];
+        if(prgi_update_pos(end))
+            prgi_printf("Scanning: [%s] %s %s", prgi_bar(0, "#."),
+                        prgi_percent(), prgi_byte_rate());
+    }
+    prgi_done();
+    prgi_printf("Mean speed: %s", prgi_byte_mean_rate());
+    printf("\nChecksum: %llu\n\n", (unsigned long long)sum);
+
+    munmap(map, size);
+    close(fd);
+
+    return 0;
+}
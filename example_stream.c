@@ -0,0 +1,81 @@
+/*
+ * prgi: example program.
+ *
+ * Copyright (C) 2023  Joao Luis Meloni Assirati.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * This example walks a random tree of chunks of work, as a program
+ * walking a directory tree would. Each chunk is discovered while its
+ * parent is processed, so the total work is not known in advance and
+ * grows with prgi_add_total() (see prgi.h). Run with -u to never
+ * tell the total, which shows an indeterminate progress.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "prgi.h"
+
+/* Terms summed in each chunk */
+#define CHUNK 1000000l
+/* Maximum number of pending chunks */
+#define MAXPENDING 1024
+
+int main(int argc, char **argv) {
+    bool unknown = argc > 1 && strcmp(argv[1], "-u") == 0;
+    long int pending = 1, n = 1, chunks = 0;
+    double s = 0, c = 0;
+
+    printf("Run %s -u to hide the total work.\n\n", argv[0]);
+
+    /* Nothing is known about the total work yet. */
+    srand(1);
+    prgi_init(0);
+    if(!unknown) prgi_add_total(CHUNK);
+
+    while(pending > 0) {
+        /* Processing a chunk discovers from zero to two new chunks. */
+        int found = rand() % 3;
+        if(chunks < 8) found = 2; /* Make the tree grow at first. */
+        if(pending + found > MAXPENDING) found = 0;
+        pending += found - 1;
+        ++chunks;
+        if(!unknown) prgi_add_total(found * CHUNK);
+
+        for(long int end = n + CHUNK; n < end; n++) {
+            double f = n, x = 1.0 / (f*f), y = x + c, t = s + y;
+            c = y - (t - s);
+            s = t;
+
+            if(prgi_update(1)) {
+                prgi_printf("[%s] %s Remaining: %s, Speed: %s terms/s",
+                            prgi_bar(0, "#."), prgi_percent(),
+                            prgi_remaining(), prgi_rate());
+                prgi_printf("Chunks done: %ld, pending: %ld", chunks, pending);
+            }
+        }
+    }
+
+    prgi_done();
+    prgi_printf("Elapsed time: %s, Mean speed: %s terms/s",
+                prgi_elapsed(), prgi_mean_rate());
+
+    printf("\n%ld chunks, s = %.14f\n\n", chunks, s);
+
+    return 0;
+}
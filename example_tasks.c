@@ -0,0 +1,97 @@
+/*
+ * prgi: example program.
+ *
+ * Copyright (C) 2023  Joao Luis Meloni Assirati.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * This example is a version of example_tutorial.c where the sum is
+ * split in three stages, each one with its own task (see
+ * prgi_task_begin() in prgi.h). The progress of the current stage is
+ * shown together with the global progress.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "prgi.h"
+
+#define NSTAGES 3
+
+int main(int argc, char **argv) {
+    long int N, n0, n1;
+    double s, c;
+    char const *labels[NSTAGES] = {"first quarter", "second quarter",
+                                   "second half"};
+    long int ends[NSTAGES];
+    prgi_task_t *stages[NSTAGES];
+
+    N = 4000000000l;
+    if(argc > 1) N = atol(argv[1]);
+    printf("Summing %ld terms\n", N);
+    printf("Run %s <Number of terms> to change the number of terms.\n\n",
+           argv[0]);
+
+    ends[0] = N/4;
+    ends[1] = N/2;
+    ends[2] = N;
+
+    /* The total work is given by the tasks. */
+    prgi_init(0);
+
+    /* Begin all stages at once, so that the global progress knows the
+       total work from the start. */
+    n0 = 0;
+    for(int i = 0; i < NSTAGES; i++) {
+        stages[i] = prgi_task_begin(NULL, ends[i] - n0, labels[i]);
+        n0 = ends[i];
+    }
+
+    s = 0;
+    c = 0;
+    n0 = 1;
+    for(int i = 0; i < NSTAGES; i++) {
+        /* The work counted by prgi_update() goes to the current stage. */
+        prgi_task_use(stages[i]);
+
+        n1 = ends[i];
+        for(long int n = n0; n <= n1; n++) {
+            double f = n, x = 1.0 / (f*f), y = x + c, t = s + y;
+            c = y - (t - s);
+            s = t;
+
+            if(prgi_update(1)) {
+                prgi_printf("Stage %d/%d (%s): %.0f%%", i + 1, NSTAGES,
+                            prgi_task_label(stages[i]),
+                            100 * prgi_task_progress(stages[i]));
+                prgi_printf("Total: [%s] %s Remaining: %s, Speed: %s terms/s",
+                            prgi_bar(0, "#."), prgi_percent(),
+                            prgi_remaining(), prgi_rate());
+            }
+        }
+        n0 = n1 + 1;
+
+        prgi_task_end(stages[i]);
+    }
+
+    /* Elapsed time and mean speed are continuous across the stages. */
+    prgi_printf("Elapsed time: %s, Mean speed: %s terms/s",
+                prgi_elapsed(), prgi_mean_rate());
+
+    printf("\npi = %.14f\n\n", sqrt(6*s));
+
+    return 0;
+}
@@ -29,6 +29,15 @@
 #include <pthread.h>
 #include <time.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <limits.h>
 
 /* thread_local. If not available, use __thread */
 #include <threads.h>
@@ -36,6 +45,11 @@
 /* NAN, isfinite() */
 #include <math.h>
 
+/* __rdtsc() */
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
 #include "prgi.h"
 
 /*
@@ -57,6 +71,12 @@
 #define PRGI_MAXBARLEN PRGI_MAXLINELEN
 #endif
 
+/* Time in seconds taken by the bar to go from one end to the other
+   when the total is not known. */
+#ifndef PRGI_BOUNCE_TIME
+#define PRGI_BOUNCE_TIME 2
+#endif
+
 /* Extra space to accomodate ANSI sequences in buffers. The value of 8
    is enough for the sequences "\e[7m" and "\e[0m" used in the
    progress bar with reverse video. If the user provided custom ANSI
@@ -71,13 +91,135 @@
 #define MAXBARLEN  PRGI_MAXBARLEN
 #define EXTRASIZE  PRGI_EXTRASIZE
 
-/* Buffer sizes take into account PRGI_EXTRASIZE and the string terminator. */
+/* Maximum number of bytes of a char in the terminal (a cell). Lines
+   are UTF-8 strings, which may contain, for example, the blocks of a
+   bar with PRGI_BLOCKS. */
+#define CELLSIZE 4
+
+/* Buffer sizes take into account CELLSIZE, PRGI_EXTRASIZE and the
+   string terminator. */
 
 /* Size of line buffers. */
-#define LINEBUFSIZE (MAXLINELEN + EXTRASIZE + 1)
+#define LINEBUFSIZE (CELLSIZE * MAXLINELEN + EXTRASIZE + 1)
 
 /* Size of progress bar buffer */
-#define BARBUFSIZE (MAXBARLEN + EXTRASIZE + 1)
+#define BARBUFSIZE (CELLSIZE * MAXBARLEN + EXTRASIZE + 1)
+
+/* Cells that may be rewritten between two changed cells of a line
+   instead of moving the cursor over them (see repaint_line()). */
+#define REPAINT_GAP 4
+
+/* Size of the frame buffer, where the output of a frame is kept
+   before it is written. */
+#ifndef PRGI_FRAMEBUFSIZE
+#define PRGI_FRAMEBUFSIZE 8192
+#endif
+
+/* Number of lines of the last frame compared with the new ones, so
+   that unchanged lines are not written again. */
+#ifndef PRGI_MAXLINES
+#define PRGI_MAXLINES 16
+#endif
+
+/* Number of messages queued by prgi_log() and maximum length of
+   each, including the terminator. Messages beyond PRGI_LOG_SLOTS are
+   dropped until the next frame. */
+#ifndef PRGI_LOG_SLOTS
+#define PRGI_LOG_SLOTS 64
+#endif
+#ifndef PRGI_LOG_LEN
+#define PRGI_LOG_LEN 256
+#endif
+
+#define FRAMEBUFSIZE PRGI_FRAMEBUFSIZE
+#define MAXLINES     PRGI_MAXLINES
+#define LOG_SLOTS    PRGI_LOG_SLOTS
+#define LOG_LEN      PRGI_LOG_LEN
+
+/* Maximum number of threads in the thread registry (see
+   register_thread()). Threads beyond this number still work, but
+   their counters are not sampled by the reporter thread; they are
+   accounted in prgi_update__() as when the reporter thread is not
+   used. */
+#ifndef PRGI_MAXTHREADS
+#define PRGI_MAXTHREADS 256
+#endif
+
+#define MAXTHREADS PRGI_MAXTHREADS
+
+/* Maximum number of contexts existing at the same time, including the
+   default one (see prgi_ctx_new()). */
+#ifndef PRGI_MAXCTX
+#define PRGI_MAXCTX 8
+#endif
+
+#define MAXCTX PRGI_MAXCTX
+
+/* Maximum number of ranks aggregated by rank 0 (see
+   prgi.aggregate). Messages from ranks beyond this number are
+   ignored. */
+#ifndef PRGI_MAXRANKS
+#define PRGI_MAXRANKS 1024
+#endif
+
+#define MAXRANKS PRGI_MAXRANKS
+
+/* Magic number of the aggregation messages ("PGAG" in little endian). */
+#define AGGREGATE_MAGIC 0x47414750
+
+/* Size of the ring buffer of samples used for prgi.rate_smoothed. */
+#ifndef PRGI_RATE_SAMPLES
+#define PRGI_RATE_SAMPLES 32
+#endif
+
+#define RATE_SAMPLES PRGI_RATE_SAMPLES
+
+/* Maximum number of samples of the throughput profile (see
+   prgi_report()). Must be even. */
+#ifndef PRGI_PROFILE_SAMPLES
+#define PRGI_PROFILE_SAMPLES 512
+#endif
+
+#define PROFILE_SAMPLES PRGI_PROFILE_SAMPLES
+
+/* Weight of the last measured rate in the moving average used by
+   PRGI_MARK_EWMA. */
+#ifndef PRGI_MARK_EWMA_WEIGHT
+#define PRGI_MARK_EWMA_WEIGHT 0.25f
+#endif
+
+/* Maximum growth factor of the mark step from one period to the next
+   used by PRGI_MARK_CAPPED. */
+#ifndef PRGI_MARK_MAXGROWTH
+#define PRGI_MARK_MAXGROWTH 2
+#endif
+
+/* Time source used to measure elapsed time. PRGI_CLOCK can be
+   defined as one of:
+   - PRGI_CLOCK_RAW: clock_gettime(CLOCK_MONOTONIC_RAW). Not subject to
+     NTP adjustments, but it may be a real system call in some
+     kernels.
+   - PRGI_CLOCK_MONOTONIC: clock_gettime(CLOCK_MONOTONIC), served by
+     the vDSO (without system call) in Linux.
+   - PRGI_CLOCK_TSC: the x86 time stamp counter, read by the rdtsc
+     instruction and calibrated against CLOCK_MONOTONIC at the first
+     call of prgi_init(). It requires an invariant TSC (constant_tsc
+     in /proc/cpuinfo), which is the case for any recent x86
+     processor. In other architectures, PRGI_CLOCK_MONOTONIC is used
+     instead.
+   Example: gcc -DPRGI_CLOCK=PRGI_CLOCK_TSC ... */
+#define PRGI_CLOCK_RAW       1
+#define PRGI_CLOCK_MONOTONIC 2
+#define PRGI_CLOCK_TSC       3
+
+#ifndef PRGI_CLOCK
+#define PRGI_CLOCK PRGI_CLOCK_RAW
+#endif
+
+#if PRGI_CLOCK == PRGI_CLOCK_TSC && !(defined(__x86_64__) || defined(__i386__))
+#undef PRGI_CLOCK
+#define PRGI_CLOCK PRGI_CLOCK_MONOTONIC
+#endif
 
 /************************************************************** Definitions ***/
 
@@ -108,14 +250,23 @@ static char *esc_skip(char const *p) {
     return (char *)p;
 }
 
-/* Like strlen(), but only counts printable characters. */
+/* Returns the number of bytes of the UTF-8 char at s. */
+static int cell_len(char const *s) {
+    int n = 1;
+    /* Continuation bytes are 10xxxxxx. */
+    while((s[n] & 0xC0) == 0x80) ++n;
+    return n;
+}
+
+/* Like strlen(), but only counts printable characters. Each UTF-8
+   char counts as one. */
 static int esc_strlen(char const *p) {
     int n = 0;
     for(;;) {
         p = esc_skip(p);
         if(*p == '\0') return n;
         ++n;
-        ++p;
+        p += cell_len(p);
     }
 }
 
@@ -135,7 +286,7 @@ static int esc_rawlen(char const *s, int l) {
         p = esc_skip(p);
         if(n == l || *p == '\0') return p - s;
         ++n;
-        ++p;
+        p += cell_len(p);
     }
 }
 
@@ -161,7 +312,7 @@ static char *sprn(char *buf, int size, char const *format, ...) {
 /* Ovewrite dest with src in center mode. If the length of src is
    greater than the length of dest, overwrite dest from the start
    respecting its size.  */
-static void overwrite_centered(char *dest, int size, char *src) {
+static void overwrite_centered(char *dest, int size, char const *src) {
     int dest_len = strlen(dest), src_len = strlen(src);
     if(dest_len > src_len) {
         memcpy(dest + (dest_len - src_len) / 2, src, src_len);
@@ -179,19 +330,71 @@ static int termwidth(FILE *f) {
     return ioctl(fileno(f), TIOCGWINSZ, &w) ? -1 : w.ws_col;
 }
 
+#if PRGI_CLOCK == PRGI_CLOCK_TSC
+
+/* A point in time, as read from the time stamp counter. */
+typedef unsigned long long int timepoint;
+
+/* Seconds per TSC tick, set by calibrate_clock(). */
+static float tsc_period;
+
+/* Sets tsc_period by comparing the TSC with CLOCK_MONOTONIC during
+   10ms. This is done only once. */
+static void calibrate_clock(void) {
+    struct timespec t0, t1, wait = {0, 10000000};
+    unsigned long long int c0, c1;
+
+    if(tsc_period != 0) return;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    c0 = __rdtsc();
+    nanosleep(&wait, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    c1 = __rdtsc();
+
+    tsc_period = ((t1.tv_sec - t0.tv_sec) + 1E-9 * (t1.tv_nsec - t0.tv_nsec))
+        / (c1 - c0);
+}
+
+/* Sets *t with the current time. */
+static void gettime(timepoint *t) {
+    *t = __rdtsc();
+}
+
+/* Return current time, in seconds, since *start (which should have been
+   previously set by gettime()) */
+static float timef(timepoint const *start) {
+    return (__rdtsc() - *start) * tsc_period;
+}
+
+#else
+
+/* A point in time, as read from clock_gettime(). */
+typedef struct timespec timepoint;
+
+/* No calibration is needed for clock_gettime(). */
+static void calibrate_clock(void) {
+}
+
 /* Sets *t with the current monotonic time. */
-static void gettime(struct timespec *t) {
+static void gettime(timepoint *t) {
+#if PRGI_CLOCK == PRGI_CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, t);
+#else
     clock_gettime(CLOCK_MONOTONIC_RAW, t);
+#endif
 }
 
 /* Return current time, in seconds, since *start (which should have been
    previously set by gettime()) */
-static float timef(struct timespec const *start) {
-    struct timespec t;
+static float timef(timepoint const *start) {
+    timepoint t;
     gettime(&t);
     return (t.tv_sec - start->tv_sec) + 1E-9f * (t.tv_nsec - start->tv_nsec);
 }
 
+#endif
+
 /* (*n)/d is assigned to *n and (*n)%d is returned */
 static int divmod(int *n, int d) {
     int r = (*n) % d;
@@ -207,7 +410,7 @@ static int divmod(int *n, int d) {
 /* struct prgi_t is defined at prgi.h. See documentation there. */
 
 /*
- * Initialize the configuration members here with default values. The
+ * Default values of the configuration members of each context. The
  * user can change these values. The other members are initialized in
  * prgi_init().
  *
@@ -215,45 +418,240 @@ static int divmod(int *n, int d) {
  * NULL. This will be changed at the first call of prgi_init() with
  * the default stream.
  */
-struct prgi_t prgi = {
-    .output = NULL,
-    .update = .2,
-    .lock_on_update = false,
+#define DEFAULT_CONFIG {                     \
+    .output = NULL,                          \
+    .update = .2,                            \
+    .lock_on_update = false,                 \
+    .mark_controller = PRGI_MARK_LINEAR,     \
+    .rate_window = 10,                       \
+    .record_fd = -1,                         \
+    .record_format = PRGI_RECORD_JSON,       \
+    .defer_flush = false,                    \
+    .handle_sigwinch = true,                 \
+    .lazy_threads = false,                   \
+    .multibar = 0,                           \
+    .aggregate = NULL,                       \
+    .rank = 0,                               \
+    .io_print = NULL,                        \
+}
+
+/* A line of prgi_multibar(). */
+struct thread_line {
+    int index;
+    long int count, total;
+    float progress, rate;
 };
 
 /* Global internal state */
 struct global_state {
     /* Starting time. timef() reports time relative to this time */
-    struct timespec start;
-    /* This mutex locks access to global and prgi. */
+    timepoint start;
+    /* This mutex locks access to prgi, to the printing state in
+       global and to the terminal. */
     pthread_mutex_t lock;
-    /* Total (full) value for the global counter. */
-    long int total;
+    /* Total (full) value for the global counter. It is atomic because
+       prgi_add_total() increments it without holding global.lock. Zero
+       or less means that the total is not known (see prgi.h). */
+    atomic_long total;
     /* Global counter. When this value reaches global.total, the
-       progress is 100% */
-    long int count;
-    /* Count and time of the last time prgi_update__() returned true. */
+       progress is 100%. It is atomically incremented by the threads
+       without holding global.lock (see prgi_update__()). */
+    atomic_long count;
+    /* Count and time of the last time prgi_update__() returned
+       true. last_time is atomic because it is also used to elect the
+       thread that will print (see prgi_update__()). */
     long int last_count;
-    float last_time;
+    _Atomic float last_time;
+    /* Copy of the status fields for prgi_snapshot(), protected by a
+       sequence lock: status_seq is odd while update_status() writes
+       it. */
+    struct prgi_snapshot status;
+    unsigned int status_seq;
 
     /* This is like prgi.width, but limited to MAXLINELEN (see
        prgi_update__().) */
     int width;
-
-    /* The following variables are used by formatting/printing functions. */
-    /* Number of lines printed by prgi_printf(). */
+    /* Value of sigwinch.resizes when the terminal width was queried
+       (see update_width()). */
+    int resizes;
+
+    /* Ring buffer with the time and count of the last updates, used
+       to calculate prgi.rate_smoothed. samples[sample_head] is the
+       most recent one. */
+    struct {
+        float time;
+        long int count;
+    } samples[RATE_SAMPLES];
+    int sample_head;
+    int nsamples;
+
+    /* Throughput profile for prgi_report(): the time and count of one
+       in each profile_stride updates since prgi_init(), in
+       order. When it is full, every other sample is dropped and
+       profile_stride doubles. profile_last is the last update, which
+       may have been skipped. */
+    struct profile_sample {
+        float time;
+        long int count;
+    } profile[PROFILE_SAMPLES], profile_last;
+    int nprofile;
+    int profile_stride, profile_skip;
+
+    /* Buffer for the records written to prgi.record_fd. */
+    char record_buf[256];
+
+    /* Ring of messages queued by prgi_log() (see drain_logs()). The
+       message at position pos is in logs[pos % LOG_SLOTS]. log_head
+       is the next position to be claimed by a writer and log_tail the
+       next one to be printed. logs_dropped counts the messages that
+       did not fit. */
+    struct {
+        atomic_ulong seq;
+        char text[LOG_LEN];
+    } logs[LOG_SLOTS];
+    atomic_ulong log_head;
+    unsigned long int log_tail;
+    atomic_long logs_dropped;
+
+    /* Counters returned by prgi_stats() (see "Instrumentation"
+       below). lock_time is the time the lock was taken. */
+    struct {
+        atomic_long slow_calls, updates, lock_wait, lock_hold;
+        atomic_long io_time, io_writes, status_updates;
+    } stats;
+    timepoint lock_time;
+
+    /* Segment exported with prgi.shm_export, or NULL. */
+    struct prgi_shm *shm;
+    char shm_name[32];
+
+    /* Socket used with prgi.aggregate, or -1. aggregate_sender is true
+       in the ranks other than 0. ranks[] has the last counters
+       received by rank 0 from each rank, which are already added to
+       count and total. */
+    int aggregate_fd;
+    bool aggregate_sender;
+    struct {
+        long int count, total;
+    } ranks[MAXRANKS];
+
+    /* The following variables are used by formatting/printing
+       functions. See "Basic output functions" below. */
+    /* Frame buffer and its length. */
+    char frame[FRAMEBUFSIZE];
+    int frame_len;
+    /* Lines on the screen and their contents. */
+    int screen_lines;
+    int cursor_line;
+    char lines[MAXLINES][LINEBUFSIZE + 8];
+    /* Lines saved by drain_logs() to be redrawn below the messages. */
+    char saved_lines[MAXLINES][LINEBUFSIZE + 8];
+    /* Number of lines printed by prgi_printf() in the current frame. */
     int printed_lines;
     /* Number of pending expandable items to be printed. */
     int expand_count;
+    /* Line formatted by prgi_printf(). */
+    char line_buf[LINEBUFSIZE];
+    /* Threads sampled by prgi_multibar(). */
+    struct thread_line thread_lines[MAXTHREADS];
+
+    /* Registry of the thread states (see register_thread()). It is
+       locked by lock. */
+    struct prgi_thread_state_ *threads[MAXTHREADS];
+    int nthreads;
+    /* Id of the next thread registered in the task, shown by
+       prgi_multibar(). */
+    int next_thread_id;
+    /* Set by prgi_init() with a number unique among all contexts, so
+       that the threads can tell whether they were initialized for the
+       current task. */
+    unsigned long int generation;
+    /* Number of prgi_init() calls. */
+    unsigned long int ntasks;
+    /* Key whose destructor unregisters exiting threads. */
+    pthread_key_t key;
+    pthread_once_t key_once;
+    bool has_key;
+
+    /* With PRGI_TICK, value of prgi_tick_ at the last update. */
+    atomic_ulong printed_tick;
+
+    /* Reporter thread (see prgi.reporter). When reporting is true,
+       registered threads never call prgi_update__(). reporter_stop is
+       locked by lock and signaled by reporter_cond. in_report is true
+       while prgi.reporter() is called with the lock held. */
+    bool reporting;
+    bool in_report;
+    bool reporter_stop;
+    pthread_t reporter;
+    pthread_cond_t reporter_cond;
+};
+
+/* State variables shared by bar formatter functions. */
+struct bar_state {
+    /* Characters used to fill the bar. */
+    char fill[2];
+    /* Text inside the bar */
+    char txt[BARBUFSIZE];
+    /* The bar drawn by bar_doit(). */
+    char buf[BARBUFSIZE];
+    /* Progress shown by the bar. It is prgi.progress except for the
+       bars of prgi_multibar(). */
+    float progress;
+    /* True if the bar formatter function was called in expandable
+       configuration (length zero) */
+    bool expand;
 };
 
-/* Initialize statically the mutex so that no
-   pthread_mutex_init()/pthread_mutex_destroy() is needed. The other
-   fields are initialized at prgi_init()/prgi_init_thread(). */
-static struct global_state global = {
+/* Context: see prgi.h. config is the struct prgi of the context,
+   state and bars are its global and bar (see below) and slot is its
+   index in contexts.slots and in parked (see use_ctx()). */
+struct prgi_ctx_t {
+    int slot;
+    struct prgi_t config;
+    struct global_state state;
+    struct bar_state bars;
+};
+
+/* The default context. Initialize statically the mutex so that no
+   pthread_mutex_init()/pthread_mutex_destroy() is needed (the other
+   contexts initialize it in prgi_ctx_new()). The other fields are
+   initialized at prgi_init()/prgi_init_thread(). */
+static struct prgi_ctx_t default_ctx = {
+    .slot = 0,
+    .config = DEFAULT_CONFIG,
+    .state = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .key_once = PTHREAD_ONCE_INIT,
+        .aggregate_fd = -1,
+    },
+};
+
+/* Process-wide state. slots has the existing contexts and is locked
+   by lock, as is ticking (whether the ticker thread was started, see
+   PRGI_TICK). tick_period is the period of the ticker thread, which
+   belongs to no context (they may be freed while it runs).
+   generation is the last value given to global.generation. */
+static struct {
+    pthread_mutex_t lock;
+    struct prgi_ctx_t *slots[MAXCTX];
+    atomic_ulong generation;
+    bool ticking;
+    _Atomic float tick_period;
+} contexts = {
     .lock = PTHREAD_MUTEX_INITIALIZER,
+    .slots = {&default_ctx},
 };
 
+/* The current context of the calling thread (see prgi_ctx_use()) and
+   its struct prgi, used by the macro prgi in prgi.h. The
+   abbreviations global and bar for the state of the current context
+   are used in this file. */
+static PRGI_THREAD_LOCAL_ struct prgi_ctx_t *current_ctx = &default_ctx;
+PRGI_THREAD_LOCAL_ struct prgi_t *prgi_current_ = &default_ctx.config;
+#define global (current_ctx->state)
+#define bar (current_ctx->bars)
+
 
 /*
  * The struct prgi_thread_state_ is defined in prgi.h. Its fields are:
@@ -268,17 +666,128 @@ static struct global_state global = {
  *   incremented in prgi_update(). When this happens, prgi_update__()
  *   is called.
  *
+ * - tick: with PRGI_TICK, value of prgi_tick_ at the last time
+ *   prgi_update__() was called. prgi_update__() is also called when
+ *   prgi_tick_ changes, so each thread accounts its work at each tick,
+ *   and mark is only used for the end of the thread's work.
+ *
+ * - step and rate: last increment of mark and estimated work rate,
+ *   used by the mark controllers (see mark_step()).
+ *
  * - last_time: last time thread the state was updated.
+ *
+ * - generation: value of global.generation when the thread was
+ *   initialized, used to attach threads lazily (see prgi.lazy_threads).
+ *
+ * - shown_count, shown_time and shown_rate: count, time and rate of
+ *   the thread the last time it was shown by prgi_multibar(). These
+ *   are written only with the lock held.
+ *
+ * - task: the current task of the thread, to which its work is
+ *   accounted besides the global counter.
+ *
+ * - id: number given to the thread when it was registered in the
+ *   task, shown by prgi_multibar(). Unlike its place in the registry,
+ *   it does not change when other threads exit.
  */
 
-/* This thread-local variable keeps the state of the thread. An
-   abbreviation for code within this file is also provided. */
-thread_local struct prgi_thread_state_ prgi_thread_;
+/* prgi_thread_ (see prgi.h) keeps the state of the thread in the
+   current context. The state in each of the other contexts is parked
+   in this thread-local array, indexed by the slot of the context (see
+   use_ctx()). An abbreviation for code within this file is also
+   provided. */
+PRGI_THREAD_LOCAL_ struct prgi_thread_state_ prgi_thread_;
+static PRGI_THREAD_LOCAL_ struct prgi_thread_state_ parked[MAXCTX];
 #define thread prgi_thread_
 
+#ifdef PRGI_TICK
+struct prgi_tick_ prgi_tick_;
+#endif
+
+/* Task: see prgi.h. total is the total of the task plus the totals of
+   all its descendants. count is the work done in the task and in its
+   descendants. */
+struct prgi_task_t {
+    struct prgi_task_t *parent;
+    char const *label;
+    atomic_long total;
+    atomic_long count;
+};
+
 /****************************************************************** Structs ***/
 
 
+/*** Instrumentation **********************************************************/
+
+/*
+ * If PRGI_STATS is defined, the functions below update the counters in
+ * global.stats. Otherwise, they are empty and the compiler removes
+ * them, so instrumentation has no cost. Times are kept in
+ * nanoseconds.
+ */
+
+#ifdef PRGI_STATS
+
+static void stat_add(atomic_long *counter, long int n) {
+    atomic_fetch_add_explicit(counter, n, memory_order_relaxed);
+}
+
+/* Sets *t with the current time. */
+static void stat_start(timepoint *t) {
+    gettime(t);
+}
+
+/* Adds the time since *t to *counter. */
+static void stat_time(atomic_long *counter, timepoint const *t) {
+    stat_add(counter, 1E9f * timef(t));
+}
+
+#else
+
+static inline void stat_add(atomic_long *counter, long int n) {
+    (void)counter;
+    (void)n;
+}
+
+static inline void stat_start(timepoint *t) {
+    (void)t;
+}
+
+static inline void stat_time(atomic_long *counter, timepoint const *t) {
+    (void)counter;
+    (void)t;
+}
+
+#endif
+
+/* Resets the counters. Called by prgi_init(). */
+static void reset_stats(void) {
+    atomic_store(&global.stats.slow_calls, 0);
+    atomic_store(&global.stats.updates, 0);
+    atomic_store(&global.stats.lock_wait, 0);
+    atomic_store(&global.stats.lock_hold, 0);
+    atomic_store(&global.stats.io_time, 0);
+    atomic_store(&global.stats.io_writes, 0);
+    atomic_store(&global.stats.status_updates, 0);
+}
+
+void prgi_stats(struct prgi_stats *out) {
+    out->slow_calls = atomic_load(&global.stats.slow_calls);
+    out->updates = atomic_load(&global.stats.updates);
+    out->lock_wait = 1E-9 * atomic_load(&global.stats.lock_wait);
+    out->lock_hold = 1E-9 * atomic_load(&global.stats.lock_hold);
+    out->io_time = 1E-9 * atomic_load(&global.stats.io_time);
+    out->io_writes = atomic_load(&global.stats.io_writes);
+    out->status_updates = atomic_load(&global.stats.status_updates);
+    out->update = prgi.update;
+    /* The first status update is done at the start of the task. */
+    out->period = out->status_updates > 1 ?
+        prgi.elapsed / (out->status_updates - 1) : NAN;
+}
+
+/********************************************************** Instrumentation ***/
+
+
 /*** Locking ******************************************************************/
 
 /*
@@ -297,16 +806,42 @@ thread_local struct prgi_thread_state_ prgi_thread_;
  * used. These stub functions are no-ops. This is a consistent
  * behavior with a single-threaded program, to which no locking is
  * needed.
+ *
+ * If PRGI_SINGLE_THREAD is defined, even the calls to the stubs are
+ * removed.
  */
 
 static void prgi_lock(void) {
+#ifndef PRGI_SINGLE_THREAD
+    timepoint t;
+    stat_start(&t);
     pthread_mutex_lock(&global.lock);
+    stat_time(&global.stats.lock_wait, &t);
+    stat_start(&global.lock_time);
+#endif
 }
 
 /* Unlike prgi_lock(), prgi_unlock() may be called by the user, so it
    is not static. See prgi.h. */
 void prgi_unlock(void) {
+#ifndef PRGI_SINGLE_THREAD
+    stat_time(&global.stats.lock_hold, &global.lock_time);
     pthread_mutex_unlock(&global.lock);
+#endif
+}
+
+/* These lock the process-wide state in contexts. */
+
+static void lock_contexts(void) {
+#ifndef PRGI_SINGLE_THREAD
+    pthread_mutex_lock(&contexts.lock);
+#endif
+}
+
+static void unlock_contexts(void) {
+#ifndef PRGI_SINGLE_THREAD
+    pthread_mutex_unlock(&contexts.lock);
+#endif
 }
 
 /****************************************************************** Locking ***/
@@ -314,64 +849,1139 @@ void prgi_unlock(void) {
 
 /*** Basic output functions ***************************************************/
 
+/*
+ * Output is not written directly to prgi.output. Instead, the lines
+ * and the cursor movements are appended to the frame buffer
+ * global.frame, which is written with a single write() by
+ * flush_frame(): once the frame has as many lines as the screen (see
+ * end_line()), or, if prgi.defer_flush is true, by prgi_flush_frame()
+ * or at the beginning of the next frame.
+ *
+ * The lines printed in a frame replace the lines of the previous
+ * frame in place: the cursor is moved to the line and the line is
+ * rewritten and the rest of it erased. Lines equal to the ones
+ * already on the screen are skipped. The following variables keep
+ * track of the screen:
+ *
+ * - global.screen_lines: number of lines printed on the screen
+ *   (since the last prgi_clear()). Line 0 is the first one.
+ *
+ * - global.cursor_line: the line where the cursor is.
+ *
+ * - global.printed_lines: number of lines printed in the current
+ *   frame. The next line to be printed is this one.
+ *
+ * - global.lines: contents of the first MAXLINES lines on the
+ *   screen.
+ */
+
 /* Returns true if is a terminal and has the minimum size to print the
    trucation indicator ">>>" */
 static bool valid_terminal(void) {
     return prgi.output && prgi.width >= 3;
 }
 
+/* Writes the frame buffer to prgi.output. */
+static void flush_frame(void) {
+    char const *p = global.frame;
+    int n = global.frame_len;
+    timepoint t;
+
+    global.frame_len = 0;
+    if(!n || !prgi.output) return;
+
+    /* Anything written to prgi.output through stdio goes first. */
+    stat_start(&t);
+    fflush(prgi.output);
+    while(n > 0) {
+        ssize_t w = write(fileno(prgi.output), p, n);
+        if(w <= 0) break; /* Output errors are ignored. */
+        p += w;
+        n -= w;
+    }
+    stat_time(&global.stats.io_time, &t);
+    stat_add(&global.stats.io_writes, 1);
+}
+
+/* Appends n chars from s to the frame buffer. */
+static void frame_add(char const *s, int n) {
+    if(global.frame_len + n > FRAMEBUFSIZE) flush_frame();
+    if(n > FRAMEBUFSIZE) n = FRAMEBUFSIZE; /* Never happens for a line. */
+    memcpy(global.frame + global.frame_len, s, n);
+    global.frame_len += n;
+}
+
+/* Appends to the frame buffer with a printf-like syntax. */
+__attribute__ ((format(printf, 1, 2)))
+static void frame_printf(char const *format, ...) {
+    char buf[32];
+    int n;
+
+    va_list ap;
+    va_start(ap, format);
+    n = vsnprintf(buf, sizeof(buf), format, ap);
+    va_end(ap);
+
+    frame_add(buf, n < (int)sizeof(buf) ? n : (int)sizeof(buf) - 1);
+}
+
+/* Moves the cursor to the beginning of the line l, which must be on
+   the screen. */
+static void move_to(int l) {
+    int d = l - global.cursor_line;
+    if(d < 0) frame_printf("\e[%dA", -d);
+    else if(d > 0) frame_printf("\e[%dB", d);
+    frame_add("\r", 1);
+    global.cursor_line = l;
+}
+
+/* Park the cursor at the end of the line. */
+static void park_cursor(void) {
+    if(global.screen_lines) frame_printf("\e[%dG", prgi.width);
+}
+
+/* Erases the lines from l to the end of the screen. */
+static void erase_from(int l) {
+    if(l >= global.screen_lines) return;
+
+    move_to(l);
+    frame_add("\e[J", 3);
+    if(l > 0) {
+        /* Line l is not on the screen anymore. */
+        frame_add("\e[A", 3);
+        global.cursor_line = l - 1;
+    }
+    global.screen_lines = l;
+}
+
+void prgi_flush_frame(void) {
+    /* If nothing was added, the cursor is already parked. */
+    if(!valid_terminal() || !global.frame_len) return;
+    park_cursor();
+    flush_frame();
+}
+
 void prgi_clear(void) {
-    if(!global.printed_lines) return; /* Nothing to do. */
+    if(!global.screen_lines) return; /* Nothing to do. */
 
     if(!valid_terminal()) {
-        /* The only thing we can do is reset global.printed lines. */
-        global.printed_lines = 0;
+        /* The only thing we can do is reset the line counters. */
+        global.screen_lines = global.printed_lines = 0;
         return;
     }
 
-    /* Return the carriage and clean the line where the cursor is */
-    fputs("\r\e[K", prgi.output);
-    --global.printed_lines;
+    erase_from(0);
+    global.printed_lines = 0;
+
+    if(!prgi.defer_flush) flush_frame();
+}
+
+/* Writes the cells from start to end of a line, which go from column
+   col to end_col. *cursor is the column of the cursor. */
+static void repaint_cells(char const *start, char const *end, int col,
+                          int end_col, int *cursor) {
+    if(col != *cursor) frame_printf("\e[%dG", col + 1);
+    frame_add(start, end - start);
+    *cursor = end_col;
+}
+
+/* Writes only the cells of line that changed from old, which is on
+   the screen at the cursor line. Returns false, without writing
+   anything, if any of the lines have escape sequences, as the cells
+   of these lines are not known. */
+static bool repaint_line(char const *old, char const *line) {
+    char const *o = old, *p = line;
+    /* A run of changed cells to be written, from start to end (between
+       the columns start_col and end_col). The cursor is at the
+       beginning of the line (see move_to()). */
+    char const *start = NULL, *end = NULL;
+    int col = 0, start_col = 0, end_col = 0, cursor = 0;
+
+    if(strchr(old, '\e') || strchr(line, '\e')) return false;
+
+    for(; *p; p += cell_len(p), ++col) {
+        int n = cell_len(p);
+
+        if(*o) {
+            int m = cell_len(o);
+            bool same = n == m && memcmp(o, p, n) == 0;
+            o += m;
+            if(same) continue;
+        }
 
-    /* Go up all the previous newlines while clearing them */
-    while(global.printed_lines) {
-        fputs("\e[A\e[K", prgi.output);
-        --global.printed_lines;
+        /* Cell changed. Join it to the current run if the gap is
+           small, as moving the cursor also takes some bytes. */
+        if(start && col - end_col > REPAINT_GAP) {
+            repaint_cells(start, end, start_col, end_col, &cursor);
+            start = NULL;
+        }
+        if(!start) {
+            start = p;
+            start_col = col;
+        }
+        end = p + n;
+        end_col = col + 1;
     }
+    if(start) repaint_cells(start, end, start_col, end_col, &cursor);
 
-    fflush(prgi.output);
+    /* Erase the rest of the old line. */
+    if(*o) {
+        if(col != cursor) frame_printf("\e[%dG", col + 1);
+        frame_add("\e[K", 3);
+    }
+
+    return true;
+}
+
+/* Accounts for a line printed in the frame. A frame replacing one with
+   the same number of lines is written at its last line, with a single
+   write(). While the frame grows, each new line is written, so the
+   lines printed after the last frame (like the final ones) are shown
+   at once. A frame with fewer lines is written at the beginning of
+   the next one or by prgi_done(). */
+static void end_line(void) {
+    ++global.printed_lines;
+    if(!prgi.defer_flush && global.printed_lines >= global.screen_lines)
+        prgi_flush_frame();
 }
 
 /* Print s to prgi.output not exceeding the terminal width. If s was
    to exceed terminal width, print ">>>" at the end of the line
-   instead of characters from s. If previous lines were printed, since
-   the last update, print a newline before printing s. Increase the
-   number of printed lines. */
-void prgi_puts(char const *s) {
-    if(!valid_terminal()) return;
-
-    /* Separate this line from the previous one. */
-    if(global.printed_lines) fputc('\n', prgi.output);
-
-    if(esc_strlen(s) <= global.width) {
-        fputs(s, prgi.output);
+   instead of characters from s. Each call prints a new line of the
+   frame, replacing the corresponding line of the last frame if it
+   is different. Increase the number of printed lines. len is the
+   length of s without escape sequences. */
+static void put_line(char const *s, int len) {
+    char line[LINEBUFSIZE + 8];
+    int l = global.printed_lines;
+
+    if(len <= global.width) {
+        snprintf(line, sizeof(line), "%s", s);
     } else {
         /* Truncate the line and append a truncation indicator
            >>>. Also, print a reset ANSI escape code in case some
            reset was lost in truncation. */
-        fprintf(prgi.output, "%.*s>>>\e[0m",
-                esc_rawlen(s, global.width - 3), s);
+        snprintf(line, sizeof(line), "%.*s>>>\e[0m",
+                 esc_rawlen(s, global.width - 3), s);
     }
 
-    /* Park the cursor at the end of the line. */
-    fprintf(prgi.output, "\e[%dG", prgi.width);
-    fflush(prgi.output);
-    ++global.printed_lines;
+    if(l < global.screen_lines) {
+        if(l < MAXLINES && strcmp(line, global.lines[l]) == 0) {
+            /* Line already on the screen. */
+            end_line();
+            return;
+        }
+        move_to(l);
+        if(l < MAXLINES && repaint_line(global.lines[l], line)) {
+            strcpy(global.lines[l], line);
+            end_line();
+            return;
+        }
+    } else {
+        /* Separate this line from the previous one. */
+        if(l) {
+            move_to(l - 1);
+            frame_add("\n", 1);
+        }
+        global.cursor_line = l;
+        ++global.screen_lines;
+    }
+
+    /* Write the line and erase what remains from the last frame. */
+    frame_add(line, strlen(line));
+    frame_add("\e[K", 3);
+    if(l < MAXLINES) strcpy(global.lines[l], line);
+    end_line();
+}
+
+void prgi_puts(char const *s) {
+    if(!valid_terminal()) return;
+    put_line(s, esc_strlen(s));
+}
+
+/*
+ * Log messages.
+ *
+ * prgi_log() queues messages in the ring global.logs, from which the
+ * printer takes them at the beginning of the next frame, so that
+ * logging never waits for the lock or for the terminal. The ring is
+ * a bounded multiple-producer queue: a writer claims a position by
+ * incrementing global.log_head with a compare-and-swap, writes the
+ * message and then publishes it in the seq of the slot. For the lap
+ * n = pos / LOG_SLOTS of the ring, seq is 2n when the slot is free
+ * for the position pos and 2n + 1 when the message at pos is
+ * ready. Zeroed slots are free for the first lap, so no
+ * initialization is needed.
+ */
+
+void prgi_log(char const *format, ...) {
+    unsigned long int pos = atomic_load(&global.log_head), seq, lap;
+    char *text;
+    int n;
+    va_list ap;
+
+    for(;;) {
+        lap = pos / LOG_SLOTS;
+        seq = atomic_load_explicit(&global.logs[pos % LOG_SLOTS].seq,
+                                   memory_order_acquire);
+        if(seq < 2 * lap) {
+            /* The slot was not printed yet in the previous lap, so
+               the ring is full. */
+            atomic_fetch_add(&global.logs_dropped, 1);
+            return;
+        }
+        /* If the slot is free, try to claim it. On failure, or if
+           another writer already claimed it, pos is reloaded. */
+        if(seq == 2 * lap) {
+            if(atomic_compare_exchange_weak(&global.log_head, &pos, pos + 1))
+                break;
+        } else {
+            pos = atomic_load(&global.log_head);
+        }
+    }
+
+    text = global.logs[pos % LOG_SLOTS].text;
+    va_start(ap, format);
+    n = vsnprintf(text, LOG_LEN, format, ap);
+    va_end(ap);
+    /* The line break is added when printing. */
+    if(n > LOG_LEN - 1) n = LOG_LEN - 1;
+    if(n > 0 && text[n - 1] == '\n') text[n - 1] = '\0';
+
+    atomic_store_explicit(&global.logs[pos % LOG_SLOTS].seq, 2 * lap + 1,
+                          memory_order_release);
+}
+
+/* Prints the queued log messages. On a terminal, the lines on the
+   screen are erased and the messages are printed in their place, so
+   they scroll up as normal output. If redraw is true, the erased
+   lines are printed again below the messages. Must be called with the
+   lock held. */
+static void drain_logs(bool redraw) {
+    char (*saved)[LINEBUFSIZE + 8] = global.saved_lines;
+    int nsaved = 0, printed = global.printed_lines;
+    bool terminal = valid_terminal();
+    long int dropped;
+
+    if(atomic_load_explicit(&global.logs[global.log_tail % LOG_SLOTS].seq,
+                            memory_order_acquire) !=
+       2 * (global.log_tail / LOG_SLOTS) + 1 &&
+       !atomic_load(&global.logs_dropped))
+        return; /* Nothing to print. */
+
+    if(terminal) {
+        /* Lines beyond MAXLINES are not known, so they are not
+           redrawn. */
+        nsaved = global.screen_lines < MAXLINES ? global.screen_lines : MAXLINES;
+        if(redraw) memcpy(saved, global.lines, sizeof(saved[0]) * nsaved);
+        erase_from(0);
+    }
+
+    for(;;) {
+        unsigned long int pos = global.log_tail, lap = pos / LOG_SLOTS;
+        char const *text = global.logs[pos % LOG_SLOTS].text;
+
+        if(atomic_load_explicit(&global.logs[pos % LOG_SLOTS].seq,
+                                memory_order_acquire) != 2 * lap + 1)
+            break; /* No more messages, or the next is being written. */
+
+        frame_add(text, strlen(text));
+        frame_add("\n", 1);
+        atomic_store_explicit(&global.logs[pos % LOG_SLOTS].seq, 2 * lap + 2,
+                              memory_order_release);
+        ++global.log_tail;
+    }
+
+    dropped = atomic_exchange(&global.logs_dropped, 0);
+    if(dropped) frame_printf("(%ld log messages dropped)\n", dropped);
+
+    if(!terminal) return;
+
+    global.printed_lines = 0;
+    if(redraw) {
+        for(int i = 0; i < nsaved; ++i) put_line(saved[i], esc_strlen(saved[i]));
+        if(global.printed_lines > printed) global.printed_lines = printed;
+    }
+}
+
+/* Begins a new frame. Called when prgi_update() returns true. If the
+   last frame had fewer lines than the screen, the extra lines are
+   erased. The queued log messages are printed first. */
+static void begin_frame(void) {
+    if(!valid_terminal()) {
+        drain_logs(false);
+        flush_frame();
+        global.screen_lines = global.printed_lines = 0;
+        return;
+    }
+
+    /* A deferred frame, or one with fewer lines than the screen, is
+       written at this point at the latest. */
+    prgi_flush_frame();
+    /* The messages are written together with the frame. */
+    drain_logs(false);
+
+    erase_from(global.printed_lines);
+    global.printed_lines = 0;
 }
 
 /*************************************************** Basic output functions ***/
 
 
+/*** Terminal width ***********************************************************/
+
+/* The SIGWINCH handler is shared by all contexts. resizes is
+   incremented by it each time the terminal width must be queried
+   again, and each context compares it with global.resizes. old is
+   the handler replaced by it. installed is locked by contexts.lock. */
+static struct {
+    volatile sig_atomic_t resizes;
+    bool installed;
+    struct sigaction old;
+} sigwinch;
+
+/* SIGWINCH handler. Calls the previous handler, if any. */
+static void sigwinch_handler(int sig, siginfo_t *info, void *context) {
+    sigwinch.resizes = sigwinch.resizes + 1;
+
+    if(sigwinch.old.sa_flags & SA_SIGINFO) {
+        if(sigwinch.old.sa_sigaction)
+            sigwinch.old.sa_sigaction(sig, info, context);
+    } else if(sigwinch.old.sa_handler != SIG_DFL &&
+              sigwinch.old.sa_handler != SIG_IGN) {
+        sigwinch.old.sa_handler(sig);
+    }
+}
+
+/* Installs sigwinch_handler() once in the process. */
+static void install_sigwinch(void) {
+    struct sigaction sa;
+
+    lock_contexts();
+    if(!sigwinch.installed) {
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = sigwinch_handler;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigwinch.installed = !sigaction(SIGWINCH, &sa, &sigwinch.old);
+    }
+    unlock_contexts();
+}
+
+/* Updates prgi.width and global.width. The terminal is queried only
+   if the width may have changed. */
+static void update_width(void) {
+    int resizes = sigwinch.resizes;
+
+    if(!sigwinch.installed || global.resizes != resizes) {
+        /* Read the counter before querying, so that a resize during
+           the query is not lost. */
+        global.resizes = resizes;
+        /* This is the true terminal width. */
+        prgi.width = termwidth(prgi.output);
+    }
+    /* This width is limited to the size of the buffers */
+    global.width = prgi.width >= MAXLINELEN + 2 ? MAXLINELEN : (prgi.width - 2);
+}
+
+/*********************************************************** Terminal width ***/
+
+
+/*** Status update ************************************************************/
+
+/* Adds a sample to the ring buffer global.samples. */
+static void add_sample(float now, long int count) {
+    global.sample_head = (global.sample_head + 1) % RATE_SAMPLES;
+    global.samples[global.sample_head].time = now;
+    global.samples[global.sample_head].count = count;
+    if(global.nsamples < RATE_SAMPLES) ++global.nsamples;
+}
+
+/* Adds a sample to the throughput profile, downsampling it if it is
+   full. */
+static void add_profile(float now, long int count) {
+    if(++global.profile_skip < global.profile_stride) return;
+    global.profile_skip = 0;
+
+    if(global.nprofile == PROFILE_SAMPLES) {
+        for(int i = 0; i < PROFILE_SAMPLES / 2; ++i)
+            global.profile[i] = global.profile[2 * i];
+        global.nprofile = PROFILE_SAMPLES / 2;
+        global.profile_stride *= 2;
+    }
+    global.profile[global.nprofile].time = now;
+    global.profile[global.nprofile].count = count;
+    ++global.nprofile;
+}
+
+/* Returns the rate over the last prgi.rate_window samples, or over
+   all samples if there are not enough of them. */
+static float smoothed_rate(void) {
+    int window = prgi.rate_window, oldest;
+
+    if(window > global.nsamples - 1) window = global.nsamples - 1;
+    if(window < 1) return NAN;
+    oldest = (global.sample_head - window + RATE_SAMPLES) % RATE_SAMPLES;
+
+    return (global.samples[global.sample_head].count -
+            global.samples[oldest].count) /
+        (global.samples[global.sample_head].time -
+         global.samples[oldest].time);
+}
+
+/* Prints x in buf as a JSON number, or null if x is not finite. */
+static char *json_number(char *buf, int size, float x) {
+    return isfinite(x) ? sprn(buf, size, "%g", x) : sprn(buf, size, "null");
+}
+
+/* Writes a record with the status fields to prgi.record_fd. */
+static void write_record(long int count) {
+    char progress[16], elapsed[16], rate[16], mean_rate[16];
+    struct prgi_record r;
+    void *data;
+    int size;
+
+    if(prgi.record_fd < 0) return;
+
+    if(prgi.record_format == PRGI_RECORD_BINARY) {
+        r.magic = PRGI_RECORD_MAGIC;
+        r.size = sizeof(r);
+        r.count = count;
+        r.total = global.total;
+        r.progress = prgi.progress;
+        r.elapsed = prgi.elapsed;
+        r.rate = prgi.rate;
+        r.mean_rate = prgi.mean_rate;
+        data = &r;
+        size = sizeof(r);
+    } else {
+        size = snprintf(global.record_buf, sizeof(global.record_buf),
+                        "{\"progress\":%s,\"elapsed\":%s,\"rate\":%s,"
+                        "\"mean_rate\":%s,\"count\":%ld,\"total\":%ld}\n",
+                        json_number(progress, 16, prgi.progress),
+                        json_number(elapsed, 16, prgi.elapsed),
+                        json_number(rate, 16, prgi.rate),
+                        json_number(mean_rate, 16, prgi.mean_rate),
+                        count, atomic_load(&global.total));
+        data = global.record_buf;
+    }
+
+    /* Records are small, so a partial write is not expected. Errors
+       are ignored, as progress reporting must not stop the task. */
+    if(write(prgi.record_fd, data, size) < 0) return;
+}
+
+/* Removes the shared memory segments of all contexts. Called at
+   exit. */
+static void unlink_shm(void) {
+    for(int i = 0; i < MAXCTX; ++i) {
+        struct prgi_ctx_t *ctx = contexts.slots[i];
+        if(ctx && ctx->state.shm) shm_unlink(ctx->state.shm_name);
+    }
+}
+
+/* Creates and maps the segment global.shm. It is done once, and the
+   segment is used by all subsequent tasks. If it fails, nothing is
+   exported. */
+static void open_shm(void) {
+    int fd;
+    void *p;
+
+    if(global.shm) return;
+
+    /* Contexts other than the default one have their slot in the
+       name. */
+    if(current_ctx->slot == 0) {
+        snprintf(global.shm_name, sizeof(global.shm_name), "/prgi.%d",
+                 (int)getpid());
+    } else {
+        snprintf(global.shm_name, sizeof(global.shm_name), "/prgi.%d.%d",
+                 (int)getpid(), current_ctx->slot);
+    }
+    fd = shm_open(global.shm_name, O_CREAT | O_RDWR, 0644);
+    if(fd < 0) return;
+    if(ftruncate(fd, sizeof(struct prgi_shm))) {
+        close(fd);
+        shm_unlink(global.shm_name);
+        return;
+    }
+    p = mmap(NULL, sizeof(struct prgi_shm), PROT_READ | PROT_WRITE,
+             MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED) {
+        shm_unlink(global.shm_name);
+        return;
+    }
+
+    global.shm = p;
+    global.shm->pid = getpid();
+    global.shm->version = PRGI_SHM_VERSION;
+    global.shm->magic = PRGI_SHM_MAGIC;
+    /* Registered by each context, but unlinking twice is harmless. */
+    atexit(unlink_shm);
+}
+
+/* Publishes the status fields in global.shm (see struct prgi_shm in
+   prgi.h). Must be called with the lock held, so there is only one
+   writer. */
+static void publish_shm(long int count) {
+    struct prgi_shm *shm = global.shm;
+    uint32_t seq;
+
+    if(!shm) return;
+
+    seq = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    shm->count = count;
+    shm->total = global.total;
+    shm->progress = prgi.progress;
+    shm->elapsed = prgi.elapsed;
+    shm->remaining = prgi.remaining;
+    shm->rate = prgi.rate;
+    shm->mean_rate = prgi.mean_rate;
+
+    __atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Copies the status fields to global.status for prgi_snapshot(). Only
+   update_status() writes global.status, with the lock held, so there
+   is a single writer. */
+static void publish_status(long int count) {
+    struct prgi_snapshot *st = &global.status;
+    unsigned int seq = global.status_seq;
+
+    __atomic_store_n(&global.status_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    st->width = prgi.width;
+    st->count = count;
+    st->total = global.total;
+    st->progress = prgi.progress;
+    st->elapsed = prgi.elapsed;
+    st->remaining = prgi.remaining;
+    st->rate = prgi.rate;
+    st->mean_rate = prgi.mean_rate;
+    st->rate_smoothed = prgi.rate_smoothed;
+    st->remaining_smoothed = prgi.remaining_smoothed;
+
+    __atomic_store_n(&global.status_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Updates the status fields in prgi with count as the global counter
+   at time now. global_dt is the time since the last update. prgi.rate
+   is updated only if update_rate is true. Must be called with the
+   lock held. */
+static void update_status(float now, long int count, float global_dt,
+                          bool update_rate) {
+    long int total = atomic_load(&global.total);
+
+    /* Progress and remaining time are undefined while the total is
+       not known. */
+    prgi.progress = total > 0 ? (float)count / total : NAN;
+    prgi.elapsed = now;
+    prgi.mean_rate = count / now;
+    /* Update prgi.rate only is enough time has passed, as it is
+       sensitive to poor statistics. */
+    if(update_rate) {
+        prgi.rate = (count - global.last_count) / global_dt;
+        add_sample(now, count);
+        prgi.rate_smoothed = smoothed_rate();
+        add_profile(now, count);
+    }
+    global.profile_last.time = now;
+    global.profile_last.count = count;
+    prgi.remaining = total > 0 ? (total - count) / prgi.rate : NAN;
+    prgi.remaining_smoothed = total > 0 ?
+        (total - count) / prgi.rate_smoothed : NAN;
+    update_width();
+
+    global.last_count = count;
+    global.expand_count = 0;
+    stat_add(&global.stats.status_updates, 1);
+
+    publish_status(count);
+
+    write_record(count);
+    publish_shm(count);
+}
+
+void prgi_snapshot(struct prgi_snapshot *out) {
+    unsigned int seq;
+
+    /* Retry while update_status() is writing or has written during the
+       copy. This never takes the lock. */
+    do {
+        while((seq = __atomic_load_n(&global.status_seq, __ATOMIC_ACQUIRE)) & 1)
+            ;
+        *out = global.status;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while(__atomic_load_n(&global.status_seq, __ATOMIC_RELAXED) != seq);
+}
+
+/************************************************************ Status update ***/
+
+
+/*** Tasks ********************************************************************/
+
+/* Adds delta to global.count and to the counters of the current task
+   of t and all its ancestors. Returns the previous value of
+   global.count. */
+static long int account(struct prgi_thread_state_ const *t, long int delta) {
+    for(struct prgi_task_t *k = t->task; k; k = k->parent)
+        atomic_fetch_add(&k->count, delta);
+    return atomic_fetch_add(&global.count, delta);
+}
+
+/* Accounts for the work pending in the calling thread. Must be called
+   with the lock held: live_count(), called with the lock held by the
+   reporter thread, would otherwise see the work both in global.count
+   and still pending in the thread. */
+static void flush_thread(void) {
+    account(&thread, thread.count - thread.last_count);
+    thread.last_count = thread.count;
+}
+
+prgi_task_t *prgi_task_begin(prgi_task_t *parent, long int total,
+                             char const *label) {
+    struct prgi_task_t *task = malloc(sizeof(*task));
+
+    if(!task) return NULL;
+    task->parent = parent;
+    task->label = label;
+    task->total = total;
+    task->count = 0;
+
+    for(struct prgi_task_t *k = parent; k; k = k->parent)
+        atomic_fetch_add(&k->total, total);
+    atomic_fetch_add(&global.total, total);
+
+    prgi_task_use(task);
+
+    return task;
+}
+
+void prgi_task_use(prgi_task_t *task) {
+    prgi_lock();
+    flush_thread();
+    prgi_unlock();
+    thread.task = task;
+
+    /* The calling thread may do all the remaining work of the task, so
+       make its end a mark (see prgi_update__()). */
+    if(task) {
+        thread.total = thread.count +
+            atomic_load(&task->total) - atomic_load(&task->count);
+        if(thread.mark > thread.total) thread.mark = thread.total;
+    }
+}
+
+void prgi_task_end(prgi_task_t *task) {
+    if(!task) return;
+    if(thread.task == task) prgi_task_use(task->parent);
+    free(task);
+}
+
+float prgi_task_progress(prgi_task_t const *task) {
+    if(!task) return prgi.progress;
+    return (float)atomic_load(&task->count) / atomic_load(&task->total);
+}
+
+char const *prgi_task_label(prgi_task_t const *task) {
+    return task ? task->label : "";
+}
+
+/******************************************************************** Tasks ***/
+
+
+/*** Thread registry **********************************************************/
+
+/*
+ * The registry keeps pointers to the thread states so that the
+ * reporter thread can sample the counters of all threads. A thread
+ * is registered at prgi_init_thread() and unregistered when it exits
+ * by the destructor of global.key. All registry functions must be
+ * called with the lock held.
+ *
+ * The counter of a registered thread is read by other threads while
+ * it is incremented in prgi_update(). This is benign: a long int is
+ * read atomically and only a slightly old value may be seen.
+ */
+
+/* Reads the work done by t that was not yet added to global.count. */
+static long int pending_count(struct prgi_thread_state_ const *t) {
+    return __atomic_load_n(&t->count, __ATOMIC_RELAXED) - t->last_count;
+}
+
+/* Returns global.count plus the work pending in all registered
+   threads. */
+static long int live_count(void) {
+    long int count = atomic_load(&global.count);
+    for(int i = 0; i < global.nthreads; ++i)
+        count += pending_count(global.threads[i]);
+    return count;
+}
+
+#ifndef PRGI_SINGLE_THREAD
+/* Removes t from the registry if it is there. Returns true if it
+   was. */
+static bool remove_thread(struct prgi_thread_state_ *t) {
+    for(int i = 0; i < global.nthreads; ++i) {
+        if(global.threads[i] == t) {
+            global.threads[i] = global.threads[--global.nthreads];
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+/* Moves the state of the calling thread in the current context from
+   *from to *to, where the registry will find it from now on. */
+static void move_thread(struct prgi_thread_state_ *from,
+                        struct prgi_thread_state_ *to) {
+    prgi_lock();
+    *to = *from;
+    for(int i = 0; i < global.nthreads; ++i) {
+        if(global.threads[i] == from) global.threads[i] = to;
+    }
+    prgi_unlock();
+}
+
+/* Makes ctx the current context of the calling thread. The state of
+   the thread in the previous context is parked and its state in ctx
+   is brought to prgi_thread_. */
+static void use_ctx(struct prgi_ctx_t *ctx) {
+    if(ctx == current_ctx) return;
+    move_thread(&thread, &parked[current_ctx->slot]);
+    current_ctx = ctx;
+    prgi_current_ = &ctx->config;
+    move_thread(&parked[ctx->slot], &thread);
+}
+
+#ifndef PRGI_SINGLE_THREAD
+/* Destructor of global.key, called when a registered thread exits. The
+   pending work is added to global.count before the thread state is
+   gone. data is the context of the key. */
+static void unregister_thread(void *data) {
+    use_ctx(data);
+    prgi_lock();
+    account(&thread, thread.count - thread.last_count);
+    thread.last_count = thread.count;
+    remove_thread(&thread);
+    prgi_unlock();
+}
+
+static void create_key(void) {
+    global.has_key = !pthread_key_create(&global.key, unregister_thread);
+}
+#endif
+
+/* Adds the calling thread to the registry. Returns false if the
+   registry is full. With PRGI_SINGLE_THREAD there are no other threads
+   to sample it, so nothing is registered. */
+static bool register_thread(void) {
+#ifdef PRGI_SINGLE_THREAD
+    return false;
+#else
+    pthread_once(&global.key_once, create_key);
+    /* In case it was already registered: then it keeps its id. */
+    if(!remove_thread(&thread)) thread.id = global.next_thread_id++;
+    if(global.nthreads == MAXTHREADS) return false;
+    global.threads[global.nthreads++] = &thread;
+    pthread_setspecific(global.key, current_ctx);
+    return true;
+#endif
+}
+
+/* Initializes the calling thread for the current task in lazy mode
+   (see prgi.lazy_threads). A thread that was never initialized has
+   zeroed state, and prgi_init() made count and last_count equal in a
+   thread registered in the previous task. In both cases, count -
+   last_count is the work done in the current task, so it is kept. */
+static void attach_thread(void) {
+    thread.mark = thread.last_count;
+    thread.last_time = 0;
+    thread.step = 0;
+    thread.rate = 0;
+    thread.generation = global.generation;
+    thread.shown_count = thread.last_count;
+    thread.shown_time = 0;
+    thread.shown_rate = NAN;
+    thread.task = NULL;
+
+    prgi_lock();
+    register_thread();
+    prgi_unlock();
+}
+
+/********************************************************** Thread registry ***/
+
+
+/*** Aggregation of ranks ****************************************************/
+
+/*
+ * With prgi.aggregate, each rank other than 0 sends its counters to
+ * rank 0 in an UDP datagram when it would otherwise print, and rank 0
+ * adds the counters of the other ranks to global.count and
+ * global.total before each status update. Sending never blocks and
+ * lost datagrams are just superseded by later ones, so the ranks are
+ * never synchronized. generation is the number of prgi_init() calls,
+ * so that messages from a previous task are ignored.
+ */
+struct aggregate_msg {
+    uint32_t magic;
+    uint32_t generation;
+    int32_t rank;
+    int64_t count;
+    int64_t total;
+};
+
+/* Opens global.aggregate_fd from prgi.aggregate ("host:port"). Rank
+   0 binds to the address and the other ranks connect to it. Errors
+   are ignored, leaving global.aggregate_fd as -1. */
+static void open_aggregate(void) {
+    struct addrinfo hints = {0}, *res;
+    char host[256];
+    char const *port = strrchr(prgi.aggregate, ':');
+    int fd;
+
+    if(global.aggregate_fd >= 0 || !port) return;
+
+    snprintf(host, sizeof(host), "%.*s", (int)(port - prgi.aggregate),
+             prgi.aggregate);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    if(prgi.rank == 0) hints.ai_flags = AI_PASSIVE;
+    if(getaddrinfo(host[0] ? host : NULL, port + 1, &hints, &res)) return;
+
+    fd = socket(res->ai_family, res->ai_socktype | SOCK_NONBLOCK,
+                res->ai_protocol);
+    if(fd >= 0) {
+        if((prgi.rank == 0 ? bind : connect)(fd, res->ai_addr,
+                                             res->ai_addrlen)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+
+    global.aggregate_fd = fd;
+    global.aggregate_sender = fd >= 0 && prgi.rank != 0;
+}
+
+/* Sends count and global.total to rank 0. */
+static void send_aggregate(long int count) {
+    struct aggregate_msg m = {
+        .magic = AGGREGATE_MAGIC,
+        .generation = global.ntasks,
+        .rank = prgi.rank,
+        .count = count,
+        .total = global.total,
+    };
+    /* Errors are ignored, as progress reporting must not stop the
+       task. */
+    send(global.aggregate_fd, &m, sizeof(m), MSG_DONTWAIT);
+}
+
+/* Adds the counters received from the other ranks since the last call
+   to global.count and global.total. Must be called with the lock
+   held. */
+static void receive_aggregate(void) {
+    struct aggregate_msg m;
+
+    if(global.aggregate_fd < 0 || global.aggregate_sender) return;
+
+    while(recv(global.aggregate_fd, &m, sizeof(m), MSG_DONTWAIT) ==
+          sizeof(m)) {
+        if(m.magic != AGGREGATE_MAGIC ||
+           m.generation != (uint32_t)global.ntasks ||
+           m.rank <= 0 || m.rank >= MAXRANKS) continue;
+        /* Datagrams may arrive out of order. */
+        if(m.count < global.ranks[m.rank].count) continue;
+
+        atomic_fetch_add(&global.count, m.count - global.ranks[m.rank].count);
+        atomic_fetch_add(&global.total, m.total - global.ranks[m.rank].total);
+        global.ranks[m.rank].count = m.count;
+        global.ranks[m.rank].total = m.total;
+    }
+}
+
+/***************************************************** Aggregation of ranks ***/
+
+
+/*** Reporter thread **********************************************************/
+
+/* Calls prgi.reporter() in the frame begun by the caller and writes
+   the frame. Must be called with the lock held. */
+static void call_reporter(void) {
+    global.in_report = true;
+    prgi.reporter();
+    global.in_report = false;
+    prgi_flush_frame();
+}
+
+/* Samples all threads, updates status and calls prgi.reporter(). Must
+   be called with the lock held. */
+static void report(void) {
+    float now = timef(&global.start);
+    receive_aggregate();
+    update_status(now, live_count(), now - global.last_time, true);
+    global.last_time = now;
+    begin_frame();
+    call_reporter();
+}
+
+#if !defined(PRGI_SINGLE_THREAD) || defined(PRGI_TICK)
+/* Advances *deadline by period seconds. */
+static void next_deadline(struct timespec *deadline, float period) {
+    long int ns = deadline->tv_nsec + (long int)(period * 1E9f);
+    deadline->tv_sec += ns / 1000000000;
+    deadline->tv_nsec = ns % 1000000000;
+}
+#endif
+
+#ifndef PRGI_SINGLE_THREAD
+/* Main function of the reporter thread. It reports each prgi.update
+   seconds until global.reporter_stop is set by stop_reporter(). */
+static void *reporter_main(void *data) {
+    struct timespec deadline;
+
+    /* Report in the context that started the thread. */
+    use_ctx(data);
+
+    prgi_lock();
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    while(!global.reporter_stop) {
+        next_deadline(&deadline, prgi.update);
+        /* The lock is not held while waiting. */
+        stat_time(&global.stats.lock_hold, &global.lock_time);
+        while(!global.reporter_stop &&
+              pthread_cond_timedwait(&global.reporter_cond, &global.lock,
+                                     &deadline) == 0);
+        stat_start(&global.lock_time);
+        if(!global.reporter_stop) report();
+    }
+    prgi_unlock();
+
+    return NULL;
+}
+#endif
+
+/* Starts the reporter thread. If it could not be started, the threads
+   keep calling prgi_update__(), which calls prgi.reporter() in its
+   place. */
+static void start_reporter(void) {
+#ifdef PRGI_SINGLE_THREAD
+    global.reporting = false;
+#else
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&global.reporter_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    global.reporter_stop = false;
+    global.reporting = !pthread_create(&global.reporter, NULL,
+                                       reporter_main, current_ctx);
+    if(!global.reporting) pthread_cond_destroy(&global.reporter_cond);
+#endif
+}
+
+/* Stops the reporter thread, if running, and waits for it. */
+static void stop_reporter(void) {
+    if(!global.reporting) return;
+
+    prgi_lock();
+    global.reporter_stop = true;
+    pthread_cond_signal(&global.reporter_cond);
+    prgi_unlock();
+
+    pthread_join(global.reporter, NULL);
+    pthread_cond_destroy(&global.reporter_cond);
+    global.reporting = false;
+}
+
+void prgi_done(void) {
+    bool reporting = global.reporting;
+    float now;
+
+    stop_reporter();
+
+    prgi_lock();
+    /* Accounts for the work pending in this thread. */
+    flush_thread();
+
+    if(global.aggregate_sender) {
+        send_aggregate(live_count());
+    } else if(reporting) {
+        report();
+    } else {
+        now = timef(&global.start);
+        receive_aggregate();
+        update_status(now, live_count(), now - global.last_time, false);
+        /* The reporter thread could not be started. */
+        if(prgi.reporter) {
+            begin_frame();
+            call_reporter();
+        }
+    }
+    /* Messages logged after the last frame are printed above it. */
+    drain_logs(true);
+    if(!prgi.defer_flush) flush_frame();
+    prgi_unlock();
+}
+
+/********************************************************** Reporter thread ***/
+
+
+/*** Ticker thread ************************************************************/
+
+#ifdef PRGI_TICK
+
+/* Main function of the ticker thread. It increments prgi_tick_ each
+   contexts.tick_period seconds until the program exits. */
+static void *ticker_main(void *data) {
+    struct timespec deadline;
+
+    (void)data;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    for(;;) {
+        next_deadline(&deadline, atomic_load(&contexts.tick_period));
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+                              NULL));
+        __atomic_fetch_add(&prgi_tick_.value, 1, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+/* Makes the ticker thread follow prgi.update and starts it if not yet
+   started. If it could not be started, only the first and last
+   updates are done. */
+static void start_ticker(void) {
+    pthread_t ticker;
+    pthread_attr_t attr;
+
+    atomic_store(&contexts.tick_period, prgi.update);
+    lock_contexts();
+    if(!contexts.ticking) {
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        contexts.ticking = !pthread_create(&ticker, &attr, ticker_main,
+                                           NULL);
+        pthread_attr_destroy(&attr);
+    }
+    unlock_contexts();
+}
+
+#endif
+
+/************************************************************ Ticker thread ***/
+
+
 /*** Initialization ***********************************************************/
 
 /* Initializes thread data. */
@@ -381,15 +1991,69 @@ void prgi_init_thread(long int total) {
     thread.last_count = 0;
     thread.mark = 0; /* Display as soon as possible */
     thread.last_time = 0;
+    thread.step = 0;
+    thread.rate = 0;
+    thread.generation = global.generation;
+    thread.shown_count = 0;
+    thread.shown_time = 0;
+    thread.shown_rate = NAN;
+    thread.task = NULL;
 
+    prgi_lock();
+    /* In reporter mode, the thread is sampled by the reporter thread
+       and never needs to call prgi_update__(). That is only when the
+       reporter is running: ranks sending their counters to rank 0 start
+       none, and it may have failed to start (see prgi_init()). Lazy
+       threads are registered so that prgi_init() can find them in the
+       next task. prgi_multibar() shows the registered threads. */
+    if(prgi.reporter || prgi.lazy_threads || prgi.multibar > 0) {
+        if(register_thread() && global.reporting) thread.mark = LONG_MAX;
+    }
     /* Increments global.total with the total work of each thread. */
+    atomic_fetch_add(&global.total, total);
+    prgi_unlock();
+}
+
+/* Adds delta to the total of the current task of the calling thread,
+   its ancestors and the whole work, without locking. */
+static void add_total(long int delta) {
+    for(struct prgi_task_t *k = thread.task; k; k = k->parent)
+        atomic_fetch_add(&k->total, delta);
+    atomic_fetch_add(&global.total, delta);
+}
+
+void prgi_add_total(long int delta) {
+    /* The calling thread may do all the new work. thread.total only
+       makes it a mark (see prgi_update__()). */
+    thread.total += delta;
+    add_total(delta);
+}
+
+void prgi_thread_attach(long int total) {
+    /* Only the first attach of the thread in the task takes the lock,
+       to register it. thread.count is never reset afterwards, since
+       the reporter thread may be sampling it. */
+    if(thread.generation != global.generation) prgi_init_thread(0);
+    /* No total mark: the end of each short job would force a print,
+       taking the lock (see prgi_update__()). */
+    thread.total = 0;
+    add_total(total);
+}
+
+void prgi_thread_detach(void) {
+    /* Without this, the work since the last due update would only be
+       accounted at the next update of the thread. */
     prgi_lock();
-    global.total += total;
+    flush_thread();
     prgi_unlock();
 }
 
 /* Initializes global and prgi data. */
 void prgi_init(long int total) {
+    /* A reporter thread from a previous task must not see the
+       reinitialization. */
+    stop_reporter();
+
     if(prgi.output == NULL) prgi.output = stdout; /* Default stream. */
 
     prgi.progress = 0;
@@ -398,25 +2062,185 @@ void prgi_init(long int total) {
     prgi.remaining = NAN;
     prgi.rate = NAN;
     prgi.mean_rate = NAN;
+    prgi.rate_smoothed = NAN;
+    prgi.remaining_smoothed = NAN;
     prgi.width = -1;
 
+    calibrate_clock();
     gettime(&global.start);
     global.total = 0; /* Will be incremented by each thread. */
     global.count = 0;
     global.last_count = 0;
     global.last_time = 0;
     global.width = -1;
+    /* prgi.output may have changed, so query its width at the first
+       update. */
+    global.resizes = sigwinch.resizes - 1;
+    if(prgi.handle_sigwinch) install_sigwinch();
+    /* The samples start with zero count at time zero. */
+    global.nsamples = 0;
+    add_sample(0, 0);
+    global.nprofile = 0;
+    global.profile_stride = 1;
+    global.profile_skip = 0;
+    add_profile(0, 0);
+    global.profile_last = global.profile[0];
+    global.frame_len = 0;
+    global.screen_lines = 0;
+    global.cursor_line = 0;
     global.printed_lines = 0;
     global.expand_count = 0;
+    /* Threads registered in a previous task may still exit later. Their
+       work must not be accounted in this task. Lazy threads attach
+       again at their next prgi_update() (see attach_thread()). */
+    for(int i = 0; i < global.nthreads; ++i) {
+        global.threads[i]->last_count = global.threads[i]->count;
+        if(prgi.lazy_threads)
+            global.threads[i]->mark = global.threads[i]->count;
+    }
+    global.nthreads = 0;
+    global.next_thread_id = 0;
+    global.generation = atomic_fetch_add(&contexts.generation, 1) + 1;
+    ++global.ntasks;
+    reset_stats();
+    memset(global.ranks, 0, sizeof(global.ranks));
+    if(prgi.aggregate) open_aggregate();
 
     /* Initialization the thread data for the "main"
        thread. global.total is also incremented here. */
     prgi_init_thread(total);
+
+    if(prgi.shm_export) {
+        open_shm();
+        prgi_lock();
+        publish_shm(0);
+        prgi_unlock();
+    }
+
+    /* Only rank 0 reports when aggregating. The main thread was
+       initialized with the reporter stopped, so it is left to the
+       reporter here if it started. The registry was emptied above, so
+       the main thread is in it. */
+    if(prgi.reporter && !global.aggregate_sender) {
+        start_reporter();
+        if(global.reporting) thread.mark = LONG_MAX;
+    }
+
+#ifdef PRGI_TICK
+    start_ticker();
+#endif
 }
 
 /*********************************************************** Initialization ***/
 
 
+/*** Contexts *****************************************************************/
+
+prgi_ctx_t *prgi_ctx_new(void) {
+    static struct prgi_t const config = DEFAULT_CONFIG;
+    pthread_once_t once = PTHREAD_ONCE_INIT;
+    struct prgi_ctx_t *ctx = calloc(1, sizeof(*ctx));
+    int slot;
+
+    if(!ctx) return NULL;
+    ctx->config = config;
+    ctx->state.key_once = once;
+    ctx->state.aggregate_fd = -1;
+    pthread_mutex_init(&ctx->state.lock, NULL);
+
+    /* Slot 0 is the default context. */
+    lock_contexts();
+    for(slot = 1; slot < MAXCTX && contexts.slots[slot]; ++slot);
+    if(slot < MAXCTX) {
+        ctx->slot = slot;
+        contexts.slots[slot] = ctx;
+    }
+    unlock_contexts();
+
+    if(slot == MAXCTX) {
+        pthread_mutex_destroy(&ctx->state.lock);
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+void prgi_ctx_free(prgi_ctx_t *ctx) {
+    struct prgi_ctx_t *prev = current_ctx;
+
+    if(!ctx || ctx == &default_ctx) return;
+
+    use_ctx(ctx);
+    stop_reporter();
+    /* Registered threads that exit later must not access ctx. */
+    if(global.has_key) pthread_key_delete(global.key);
+    if(global.aggregate_fd >= 0) close(global.aggregate_fd);
+    if(global.shm) {
+        munmap(global.shm, sizeof(struct prgi_shm));
+        shm_unlink(global.shm_name);
+    }
+    /* Leaving ctx takes its lock. */
+    use_ctx(prev == ctx ? &default_ctx : prev);
+    pthread_mutex_destroy(&ctx->state.lock);
+
+    lock_contexts();
+    contexts.slots[ctx->slot] = NULL;
+    unlock_contexts();
+
+    free(ctx);
+}
+
+prgi_ctx_t *prgi_ctx_use(prgi_ctx_t *ctx) {
+    struct prgi_ctx_t *prev = current_ctx;
+
+    use_ctx(ctx ? ctx : &default_ctx);
+    return prev == &default_ctx ? NULL : prev;
+}
+
+/***************************************************************** Contexts ***/
+
+
+/*** I/O wrappers *************************************************************/
+
+void prgi_init_fd(int fd) {
+    struct stat st;
+    off_t pos;
+    long int total = 0;
+
+    /* The size of pipes, sockets and terminals is not known, so their
+       total is unknown (see prgi_add_total()). Only the bytes after
+       the current offset will be read. */
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        pos = lseek(fd, 0, SEEK_CUR);
+        total = st.st_size - (pos > 0 ? pos : 0);
+    }
+
+    prgi_init(total);
+}
+
+/* Counts n bytes as work done, printing with prgi.io_print() when
+   prgi_update() returns true. */
+static void io_update(long int n) {
+    if(!prgi_update(n)) return;
+    if(prgi.io_print) prgi.io_print();
+    if(prgi.lock_on_update) prgi_unlock();
+}
+
+ssize_t prgi_read(int fd, void *buf, size_t n) {
+    ssize_t r = read(fd, buf, n);
+    if(r > 0) io_update(r);
+    return r;
+}
+
+size_t prgi_fread(void *ptr, size_t size, size_t n, FILE *stream) {
+    size_t r = fread(ptr, size, n, stream);
+    if(r > 0) io_update(r * size);
+    return r;
+}
+
+/************************************************************* I/O wrappers ***/
+
+
 /*** prgi_update__() **********************************************************/
 
 /*
@@ -434,71 +2258,173 @@ void prgi_init(long int total) {
  * - thread.mark is recalculated so that thread.count takes prgi.update
  *   seconds to exceed it at prgi_update()
  *
- * - global.count is incremented according to thread.count variation.
+ * - global.count is atomically incremented according to thread.count
+ *   variation.
  *
  * - if enough time has passed since the last time, all prgi.xxx
  *   variables are updated, the lines previously printed are ereased,
  *   the cursor is positioned for the next print and true is
  *   returned. Otherwise, false is returned.
+ *
+ * Only the thread that will print takes global.lock. When enough
+ * time has passed, all threads crossing their marks compete to
+ * replace global.last_time with their current time with a
+ * compare-and-swap. The only winner is the printer for that
+ * period. The others, and all threads that cross their marks before
+ * enough time has passed, return false without ever blocking. The
+ * first and last updates of each thread are always printed, so
+ * these take the lock unconditionally.
+ *
+ * With PRGI_TICK, prgi_update() also calls prgi_update__() when
+ * prgi_tick_ changes, the mark is not recalculated and the printer is
+ * the first thread to see each new tick.
  */
 
+#ifndef PRGI_TICK
+
+/* Returns the increment of thread.mark so that thread.count takes
+   prgi.update seconds to reach it, given that the thread did delta
+   work in the last dt seconds. See prgi.mark_controller in prgi.h. */
+static long int mark_step(long int delta, float dt) {
+    float rate = delta / dt;
+    float step;
+
+    switch(prgi.mark_controller) {
+    case PRGI_MARK_EWMA:
+        /* The first measured rate initializes the average. */
+        if(thread.rate > 0) rate = thread.rate +
+                                PRGI_MARK_EWMA_WEIGHT * (rate - thread.rate);
+        thread.rate = rate;
+        step = prgi.update * rate;
+        break;
+    case PRGI_MARK_CAPPED:
+        step = prgi.update * rate;
+        if(thread.step > 0 && step > PRGI_MARK_MAXGROWTH * thread.step)
+            step = PRGI_MARK_MAXGROWTH * thread.step;
+        break;
+    default:
+        step = prgi.update * rate;
+        break;
+    }
+
+    /* Avoid overflows when dt is too small and NaN when no work was
+       done. */
+    if(!(step > 0)) step = 0;
+    thread.step = step < LONG_MAX / 2 ? step : LONG_MAX / 2;
+    return thread.step;
+}
+
+#endif
+
 /*
  * This function is called by prgi_update().
  * - Updates thread data.
  * - Updates global.count
  * - If enough time has passed, updates prgi data, prepares the
  *   terminal for printing and returns true. Otherwise, returns false.
- * - Access to global and prgi data is locked to other threads during
- *   function execution.
+ * - Access to prgi data and to the terminal is locked to other
+ *   threads only when the calling thread is going to print.
  */
 bool prgi_update__(void) {
-    long int thread_delta = thread.count - thread.last_count;
-    float now = timef(&global.start);
-    float global_dt;
-    bool ready;
+    long int thread_delta;
+    float now, last_time, global_dt;
+    long int count;
+    bool ready, forced;
+#ifdef PRGI_TICK
+    unsigned long int tick = __atomic_load_n(&prgi_tick_.value,
+                                             __ATOMIC_RELAXED);
+    unsigned long int printed_tick;
+#endif
 
-    prgi_lock();
+    stat_add(&global.stats.slow_calls, 1);
 
-    thread.mark += (prgi.update * thread_delta) / (now - thread.last_time);
+    if(prgi.lazy_threads && thread.generation != global.generation)
+        attach_thread();
+    thread_delta = thread.count - thread.last_count;
+
+    /* In lazy mode the share of the thread is not known, but it can't
+       be more than the work remaining globally. */
+    if(prgi.lazy_threads)
+        thread.total = thread.count +
+            global.total - atomic_load(&global.count) - thread_delta;
+
+    /* thread.xxx variables are not shared, so no locking is needed. */
+#ifndef PRGI_TICK
+    now = timef(&global.start);
+    thread.mark += mark_step(thread_delta, now - thread.last_time);
     /* Make the total a mark, so that 100% will eventually be shown. */
     if(thread.count < thread.total && thread.mark > thread.total)
         thread.mark = thread.total;
-    thread.last_count = thread.count;
     thread.last_time = now;
+#else
+    /* The next update is told by prgi_tick_ and the total is the only
+       mark. */
+    thread.tick = tick;
+    thread.mark = thread.count < thread.total ? thread.total : LONG_MAX;
+#endif
+    thread.last_count = thread.count;
+
+    /* Previous value of global.count is zero on the first update. */
+    forced = account(&thread, thread_delta) == 0 ||
+        thread.count == thread.total;
 
-    global.count += thread_delta;
-    global_dt = now - global.last_time;
+    /* Only the reporter thread prints in reporter mode. Threads that
+       did not fit in the registry reach this point. */
+    if(global.reporting) return false;
 
+#ifndef PRGI_TICK
     /* Due to thread.mark being an estimate, the time since last
        update may be different from prgi.update. Use a threshold to
-       detect enough time to print. */
-    ready = global_dt > 0.8 * prgi.update;
+       detect enough time to print. If it is the case, try to elect
+       this thread as the printer. */
+    last_time = atomic_load(&global.last_time);
+    ready = now - last_time > 0.8 * prgi.update &&
+        atomic_compare_exchange_strong(&global.last_time, &last_time, now);
+#else
+    /* The first thread to see a new tick is elected as the printer. */
+    printed_tick = atomic_load(&global.printed_tick);
+    ready = printed_tick != tick &&
+        atomic_compare_exchange_strong(&global.printed_tick, &printed_tick,
+                                       tick);
+#endif
 
     /* All threads are competing to print. Allow a thread to print
-       only if enough time has passed since the last print. Besides,
-       print on first and last updates. */
-    if(!(ready || global.count==thread_delta || thread.count==thread.total)) {
-        prgi_unlock();
+       only if it was elected or if it is the first or last
+       update. */
+    if(!(ready || forced)) return false;
+
+#ifdef PRGI_TICK
+    /* Only the printing thread reads the clock. */
+    now = timef(&global.start);
+    last_time = atomic_exchange(&global.last_time, now);
+#endif
+
+    /* Ranks other than 0 don't print. */
+    if(global.aggregate_sender) {
+        send_aggregate(atomic_load(&global.count));
         return false;
     }
 
-    prgi.progress = (float)global.count / global.total;
-    prgi.elapsed = now;
-    prgi.mean_rate = global.count / now;
-    /* Update prgi.rate only is enough time has passed, as it is
-       sensitive to poor statistics. */
-    if(ready) prgi.rate = (global.count - global.last_count) / global_dt;
-    prgi.remaining = (global.total - global.count) / prgi.rate;
-    /* This is the true terminal width. */
-    prgi.width = termwidth(prgi.output);
-    /* This width is limited to the size of the buffers */
-    global.width = prgi.width >= MAXLINELEN + 2 ? MAXLINELEN : (prgi.width - 2);
+    prgi_lock();
 
-    global.last_count = global.count;
-    global.last_time = now;
-    global.expand_count = 0;
+    if(!ready) atomic_store(&global.last_time, now);
+    global_dt = now - last_time;
+    receive_aggregate();
+    count = atomic_load(&global.count);
+
+    update_status(now, count, global_dt, ready);
+    begin_frame();
+
+    stat_add(&global.stats.updates, 1);
 
-    prgi_clear();
+    /* The reporter thread could not be started (see start_reporter()).
+       The program ignores the return value of prgi_update() in
+       reporter mode, so prgi.reporter() is called here instead. */
+    if(prgi.reporter) {
+        call_reporter();
+        prgi_unlock();
+        return false;
+    }
 
     if(!prgi.lock_on_update) prgi_unlock();
     return true;
@@ -511,13 +2437,15 @@ bool prgi_update__(void) {
  * Formatter functions: these functions provide formatted output for
  * the variables in the struct prgi.
  *
- * prgi member        Formatter function
+ * prgi member              Formatter function
  *
- * prgi.progress:     prgi_bar(), prgi_txt() and prgi_percent()
- * prgi.remaining:    prgi_remaining()
- * prgi.elapsed:      prgi_elapsed()
- * prgi.rate:         prgi_rate()
- * prgi.mean_rate:    prgi_mean_rate()
+ * prgi.progress:           prgi_bar(), prgi_txt() and prgi_percent()
+ * prgi.remaining:          prgi_remaining()
+ * prgi.elapsed:            prgi_elapsed()
+ * prgi.rate:               prgi_rate()
+ * prgi.mean_rate:          prgi_mean_rate()
+ * prgi.rate_smoothed:      prgi_rate_smoothed()
+ * prgi.remaining_smoothed: prgi_remaining_smoothed()
  *
  * All these functions write the formatted output in strings at static
  * buffers and return a pointer to that string.
@@ -526,42 +2454,86 @@ bool prgi_update__(void) {
 
 /*** prgi_bar(), prgi_bartxt() and prgi_percent() *****************************/
 
-/* State variables shared by bar formatter functions. */
-struct bar_state {
-    /* Characters used to fill the bar. */
-    char fill[2];
-    /* Text inside the bar */
-    char txt[BARBUFSIZE];
-    /* True if the bar formatter function was called in expandable
-       configuration (length zero) */
-    bool expand;
-};
-struct bar_state bar;
-
-/* Fill the first n chars of buf with bar.fill[0] and the following
-   len - n char with bar.fill[1]. Then overwrite the center of this
-   string with bar.txt. n and len must be <= MAXBARLEN. */
-static void bar_fill(char *buf, int n, int len) {
-    memset(buf, bar.fill[0], n);
-    memset(buf + n, bar.fill[1], len - n);
+/* Fill the first n chars of buf with fill[0] and the following len - n
+   char with fill[1]. Then overwrite the center of this string with
+   txt. buf must have size BARBUFSIZE and n and len must be <=
+   MAXBARLEN. */
+static void bar_fill(char *buf, int n, int len, char const *fill,
+                     char const *txt) {
+    memset(buf, fill[0], n);
+    memset(buf + n, fill[1], len - n);
     buf[len] = '\0';
-    overwrite_centered(buf, BARBUFSIZE, bar.txt);
+    overwrite_centered(buf, BARBUFSIZE, txt);
 }
 
-/* Draw a progress bar in the internal static buffer buf[] of length
-   len. bar.fill and bar.txt must be already configured. */
-static char *bar_doit(int len) {
-    static char buf[BARBUFSIZE];
-    int n;
+/* Blocks with 0/8, 1/8, ..., 8/8 of the width of a cell, used by bars
+   with PRGI_BLOCKS. */
+static char const *const blocks[] = {
+    " ", "\u258f", "\u258e", "\u258d", "\u258c", "\u258b", "\u258a",
+    "\u2589", "\u2588",
+};
 
-    /* Return a zero-length string. This is a intermediary state
-       for calculating the available space for an expandable bar. */
-    if(len <= 0) {
-        bar.expand = true;
-        ++global.expand_count;
-        return buf[0] = '\0', buf;
+/* Draws a bar of len <= MAXBARLEN cells with blocks in buf, which has
+   the given size, with a resolution of 1/8 of a cell. */
+static char *blocks_render(char *buf, int size, float progress, int len) {
+    char aux[BARBUFSIZE], *p = aux;
+    int n = myround(8 * len * progress);
+
+    if(n > 8 * len) n = 8 * len;
+
+    /* Each full block has 3 bytes, so aux is never exceeded. */
+    for(int i = 0; i < n / 8; ++i) p = stpcpy(p, blocks[8]);
+    if(n % 8) p = stpcpy(p, blocks[n % 8]);
+    for(int i = (n + 7) / 8; i < len; ++i) *p++ = ' ';
+    *p = '\0';
+
+    snprintf(buf, size, "%s", aux);
+    return buf;
+}
+
+/* Draws in buf, which has the given size, a bar of len <= MAXBARLEN
+   cells with a filled segment bouncing from one end of the bar to the
+   other, for an unknown progress. The position of the segment is
+   given by the elapsed time. */
+static char *bounce_render(char *buf, int size, float elapsed, int len,
+                           char const *fill, char const *txt) {
+    char aux[BARBUFSIZE], *p = aux;
+    int w = len / 5, travel = len - w;
+    /* Each sweep takes PRGI_BOUNCE_TIME seconds. */
+    long int pos = elapsed > 0 ? elapsed * travel / PRGI_BOUNCE_TIME : 0;
+
+    pos %= 2 * travel;
+    if(pos > travel) pos = 2 * travel - pos;
+
+    if(fill[0] == PRGI_BLOCKS[0]) {
+        /* Each full block has 3 bytes, so aux is never exceeded. */
+        for(int i = 0; i < len; ++i)
+            p = stpcpy(p, i >= pos && i < pos + w ? blocks[8] : " ");
+        snprintf(buf, size, "%s", aux);
+    } else if(fill[1] != '\0') {
+        memset(aux, fill[1], len);
+        memset(aux + pos, fill[0], w);
+        aux[len] = '\0';
+        overwrite_centered(aux, BARBUFSIZE, txt);
+        snprintf(buf, size, "%s", aux);
+    } else {
+        bar_fill(aux, len, len, fill, txt);
+        snprintf(buf, size, "%.*s\e[7m%.*s\e[0m%s", (int)pos, aux, w,
+                 aux + pos, aux + pos + w);
     }
 
+    return buf;
+}
+
+/* Draw a progress bar of length len showing progress in buf, which
+   has the given size. fill and txt are used as in prgi_bartxt(). If
+   progress is NaN (unknown total), the bar bounces according to
+   elapsed. This function is reentrant. */
+static char *bar_render(char *buf, int size, float progress, float elapsed,
+                        int len, char const *fill, char const *txt) {
+    char aux[BARBUFSIZE];
+    int n;
+
     /* Minimum and maximum bar lengths */
     if(len < 10) {
         len = 10;
@@ -569,46 +2541,92 @@ static char *bar_doit(int len) {
         len = MAXBARLEN;
     }
 
+    if(isnan(progress)) return bounce_render(buf, size, elapsed, len, fill, txt);
+    if(fill[0] == PRGI_BLOCKS[0]) return blocks_render(buf, size, progress, len);
+
     /* Number of "filled" chars in the progress bar. Don't report more
        than 100%.  */
-    n = myround(len * prgi.progress);
+    n = myround(len * progress);
     if(n > len) n = len;
 
     /* It is guaranteed here that n <= len <= MAXBARLEN, so bar_fill()
        can be safely called below. */
 
-    if(bar.fill[1] != '\0') {
-        /* Pure ASCII bar using bar.fill[0] and bar.fill[1]. */
-        bar_fill(buf, n, len);
+    if(fill[1] != '\0') {
+        /* Pure ASCII bar using fill[0] and fill[1]. */
+        bar_fill(aux, n, len, fill, txt);
+        snprintf(buf, size, "%s", aux);
     } else {
-        /* Fill the whole bar with bar.fill[0] and use ANSI escape
-           codes to reverse video of the first n chars. */
-        static char aux[BARBUFSIZE];
-        bar_fill(aux, len, len);
+        /* Fill the whole bar with fill[0] and use ANSI escape codes to
+           reverse video of the first n chars. */
+        bar_fill(aux, len, len, fill, txt);
         /* Copy aux to buf with the n first chars inverted. */
-        snprintf(buf, BARBUFSIZE, "\e[7m%.*s\e[0m%s", n, aux, aux + n);
+        snprintf(buf, size, "\e[7m%.*s\e[0m%s", n, aux, aux + n);
     }
 
     return buf;
 }
 
+/* Draw a progress bar in bar.buf of length len. bar.fill and bar.txt
+   must be already configured. */
+static char *bar_doit(int len) {
+    /* Return a zero-length string. This is a intermediary state
+       for calculating the available space for an expandable bar. */
+    if(len <= 0) {
+        bar.expand = true;
+        ++global.expand_count;
+        return bar.buf[0] = '\0', bar.buf;
+    }
+
+    return bar_render(bar.buf, BARBUFSIZE, bar.progress, prgi.elapsed, len,
+                      bar.fill, bar.txt);
+}
+
 /* prgi_bar() and prgi_bartxt() configure bar.fill and bar.txt. */
 
 char *prgi_bar(int len, char const *fill) {
     memcpy(bar.fill, fill, 2);
     bar.txt[0] = '\0';
+    bar.progress = prgi.progress;
     return bar_doit(len);
 }
 
 char *prgi_bartxt(int len, char const *fill, char const *format, ...) {
     memcpy(bar.fill, fill, 2);
     auto_vsnprintf(bar.txt, BARBUFSIZE, format);
+    bar.progress = prgi.progress;
     return bar_doit(len);
 }
 
+/* Prints progress in buf as a percentage, or "?%" if it is unknown. */
+static char *percent(char *buf, int size, float progress) {
+    if(isnan(progress)) return sprn(buf, size, "?%%");
+    return sprn(buf, size, "%.0f%%", 100 * progress);
+}
+
 char *prgi_percent(void) {
     static char buf[5];
-    return sprn(buf, 5, "%.0f%%", 100 * prgi.progress);
+    return percent(buf, 5, prgi.progress);
+}
+
+/* When len is not positive, the bar takes the whole terminal width. */
+char *prgi_bar_r(char *buf, size_t size, struct prgi_snapshot const *s,
+                 int len, char const *fill) {
+    return prgi_bartxt_r(buf, size, s, len, fill, "");
+}
+
+char *prgi_bartxt_r(char *buf, size_t size, struct prgi_snapshot const *s,
+                    int len, char const *fill, char const *txt) {
+    char f[2];
+    if(len <= 0) len = s->width - 2;
+    /* fill may have only one char followed by the terminator. */
+    f[0] = fill[0];
+    f[1] = fill[0] ? fill[1] : '\0';
+    return bar_render(buf, size, s->progress, s->elapsed, len, f, txt);
+}
+
+char *prgi_percent_r(char *buf, size_t size, struct prgi_snapshot const *s) {
+    return percent(buf, size, s->progress);
 }
 
 /***************************** prgi_bar(), prgi_bartxt() and prgi_percent() ***/
@@ -648,6 +2666,25 @@ char *prgi_remaining(void) {
     return timehms(buf, 32, prgi.remaining);
 }
 
+char *prgi_remaining_smoothed(void) {
+    static char buf[32];
+    return timehms(buf, 32, prgi.remaining_smoothed);
+}
+
+char *prgi_remaining_r(char *buf, size_t size,
+                       struct prgi_snapshot const *s) {
+    return timehms(buf, size, s->remaining);
+}
+
+char *prgi_elapsed_r(char *buf, size_t size, struct prgi_snapshot const *s) {
+    return timehms(buf, size, s->elapsed);
+}
+
+char *prgi_remaining_smoothed_r(char *buf, size_t size,
+                                struct prgi_snapshot const *s) {
+    return timehms(buf, size, s->remaining_smoothed);
+}
+
 char *prgi_elapsed(void) {
     static char buf[32];
     return timehms(buf, 32, prgi.elapsed);
@@ -706,26 +2743,97 @@ char *prgi_mean_rate(void) {
     return sipref(buf, 32, prgi.mean_rate);
 }
 
+char *prgi_rate_smoothed(void) {
+    static char buf[32];
+    return sipref(buf, 32, prgi.rate_smoothed);
+}
+
+char *prgi_rate_r(char *buf, size_t size, struct prgi_snapshot const *s) {
+    return sipref(buf, size, s->rate);
+}
+
+char *prgi_mean_rate_r(char *buf, size_t size,
+                       struct prgi_snapshot const *s) {
+    return sipref(buf, size, s->mean_rate);
+}
+
+char *prgi_rate_smoothed_r(char *buf, size_t size,
+                           struct prgi_snapshot const *s) {
+    return sipref(buf, size, s->rate_smoothed);
+}
+
+/* Prints the byte rate x on buf with binary prefixes (powers of 1024)
+   followed by "B/s". It works for x > 1. */
+static char *binpref(char *buf, int size, double x) {
+    static char const *const pw[] = {
+        "Ki", "Mi", "Gi", "Ti", "Pi", "Ei", "Zi", "Yi", NULL
+    };
+
+    int i;
+
+    if(!isfinite(x) || x < 0) return sprn(buf, size, "?");
+
+    /* When x < 1000, no prefix. Values from 1000 to 1023 are shown
+       with the next prefix (0.98 to 1.00) to keep 3 digits. */
+    if(x < 1000) return sprn(buf, size, "%.*fB/s", dec3(x), x);
+
+    for(i = 0; ; ++i) {
+        x /= 1024;
+        if(x < 1000 || pw[i+1] == NULL) break;
+    }
+
+    /* If x is too big, the last prefix has more digits. */
+    return sprn(buf, size, "%.*f%sB/s", x < 1000 ? dec3(x) : 0, x, pw[i]);
+}
+
+char *prgi_byte_rate(void) {
+    static char buf[32];
+    return binpref(buf, 32, prgi.rate);
+}
+
+char *prgi_byte_mean_rate(void) {
+    static char buf[32];
+    return binpref(buf, 32, prgi.mean_rate);
+}
+
+char *prgi_byte_rate_r(char *buf, size_t size, struct prgi_snapshot const *s) {
+    return binpref(buf, size, s->rate);
+}
+
+char *prgi_byte_mean_rate_r(char *buf, size_t size,
+                            struct prgi_snapshot const *s) {
+    return binpref(buf, size, s->mean_rate);
+}
+
 /***************************************** prgi_rate() and prgi_mean_rate() ***/
 
 
 /*** prgi_throbber() **********************************************************/
 
-int prgi_throbber(char const *anim) {
-    static int i = 0;
+int prgi_throbber_r(char const *anim, unsigned int *state,
+                    struct prgi_snapshot const *s) {
     int c;
 
     /* Don't display the throbber if 100% */
-    if(global.count == global.total) return ' ';
+    if(s->count == s->total) return ' ';
 
-    c = anim[i++];
+    c = anim[(*state)++];
     if(c == '\0') {
         c = anim[0];
-        i = 1;
+        *state = 1;
     }
     return c;
 }
 
+int prgi_throbber(char const *anim) {
+    static unsigned int i = 0;
+    struct prgi_snapshot s;
+
+    s.count = atomic_load(&global.count);
+    s.total = global.total;
+    return prgi_throbber_r(anim, &i, &s);
+}
+
 /********************************************************** prgi_throbber() ***/
 
 
@@ -736,7 +2844,7 @@ int prgi_throbber(char const *anim) {
    these items and call the corresponding string-print
    functions. Then, print the line with prgi_fputs(). */
 void prgi_printf(char const *format, ...) {
-    static char line_buf[LINEBUFSIZE];
+    char *line_buf = global.line_buf;
 
     if(!valid_terminal()) return;
 
@@ -767,3 +2875,405 @@ void prgi_printf(char const *format, ...) {
 }
 
 /************************************************************ prgi_printf() ***/
+
+
+/*** prgi_multibar() **********************************************************/
+
+/* Sorts thread lines by increasing progress. */
+static int cmp_thread_lines(void const *a, void const *b) {
+    float pa = ((struct thread_line const *)a)->progress;
+    float pb = ((struct thread_line const *)b)->progress;
+    return (pa > pb) - (pa < pb);
+}
+
+/* Samples the registered threads with work to do in lines and returns
+   the number of lines. Must be called with the lock held. */
+static int sample_threads(struct thread_line *lines, float now) {
+    int n = 0;
+
+    for(int i = 0; i < global.nthreads; ++i) {
+        struct prgi_thread_state_ *t = global.threads[i];
+        struct thread_line *l = &lines[n];
+        float dt = now - t->shown_time;
+
+        if(t->total <= 0) continue;
+
+        l->index = t->id;
+        l->count = __atomic_load_n(&t->count, __ATOMIC_RELAXED);
+        l->total = t->total;
+        l->progress = l->count < l->total ? (float)l->count / l->total : 1;
+        /* As in prgi_update__(), the rate needs enough time to be
+           meaningful. */
+        if(dt > 0.8 * prgi.update) {
+            t->shown_rate = (l->count - t->shown_count) / dt;
+            t->shown_count = l->count;
+            t->shown_time = now;
+        }
+        l->rate = t->shown_rate;
+        ++n;
+    }
+
+    return n;
+}
+
+void prgi_multibar(void) {
+    struct thread_line *lines = global.thread_lines;
+    /* The lock is already held when called from prgi.reporter() or
+       after prgi_update() with prgi.lock_on_update. */
+    bool lock = !global.in_report && !prgi.lock_on_update;
+    int n, shown;
+
+    if(!valid_terminal() || prgi.multibar <= 0) return;
+
+    if(lock) prgi_lock();
+
+    n = sample_threads(lines, timef(&global.start));
+    qsort(lines, n, sizeof(lines[0]), cmp_thread_lines);
+
+    /* Keep the last line for the hidden threads. */
+    shown = n <= prgi.multibar ? n : prgi.multibar - 1;
+    for(int i = 0; i < shown; ++i) {
+        struct thread_line const *l = &lines[i];
+        char rate[32], remaining[32];
+
+        sipref(rate, sizeof(rate), l->rate);
+        timehms(remaining, sizeof(remaining), (l->total - l->count) / l->rate);
+        memcpy(bar.fill, "#.", 2);
+        bar.txt[0] = '\0';
+        bar.progress = l->progress;
+        prgi_printf("%2d %3.0f%% [%s] %s/s %s", l->index, 100 * l->progress,
+                    bar_doit(0), rate, remaining);
+    }
+    if(shown < n) prgi_printf("+%d more threads", n - shown);
+
+    if(lock) prgi_unlock();
+}
+
+/********************************************************** prgi_multibar() ***/
+
+
+/*** Layouts ******************************************************************/
+
+/* Kinds of the items of a layout. */
+enum layout_kind {
+    ITEM_TEXT,
+    ITEM_PERCENT,
+    ITEM_BAR,
+    ITEM_ELAPSED,
+    ITEM_REMAINING,
+    ITEM_RATE,
+    ITEM_MEAN_RATE,
+    ITEM_RATE_SMOOTHED,
+    ITEM_REMAINING_SMOOTHED,
+    ITEM_THROBBER,
+    ITEM_BYTE_RATE,
+    ITEM_BYTE_MEAN_RATE,
+};
+
+/* Names of the placeholders and default arguments. */
+static struct {
+    char const *name;
+    enum layout_kind kind;
+    char const *arg;
+} const layout_names[] = {
+    {"percent", ITEM_PERCENT, ""},
+    {"bar", ITEM_BAR, "#."},
+    {"elapsed", ITEM_ELAPSED, ""},
+    {"remaining", ITEM_REMAINING, ""},
+    {"eta", ITEM_REMAINING, ""},
+    {"rate", ITEM_RATE, ""},
+    {"mean_rate", ITEM_MEAN_RATE, ""},
+    {"rate_smoothed", ITEM_RATE_SMOOTHED, ""},
+    {"remaining_smoothed", ITEM_REMAINING_SMOOTHED, ""},
+    {"throbber", ITEM_THROBBER, "|/-\\"},
+    {"byte_rate", ITEM_BYTE_RATE, ""},
+    {"byte_mean_rate", ITEM_BYTE_MEAN_RATE, ""},
+};
+#define NLAYOUT_NAMES (sizeof(layout_names) / sizeof(layout_names[0]))
+
+/* An item of a layout. text is the text of an ITEM_TEXT, the fill
+   chars of an ITEM_BAR or the animation of an ITEM_THROBBER. width is
+   the length of the text without escape sequences, or of the
+   formatted field in buf. state is the state of the throbber. */
+struct layout_item {
+    enum layout_kind kind;
+    char const *text;
+    int width;
+    unsigned int state;
+    char buf[32];
+};
+
+/* Layout: see prgi.h. The texts of the items are kept in pool. width
+   is the total width of the text items. */
+struct prgi_layout_t {
+    char *pool;
+    int nitems, nbars, width;
+    struct layout_item items[];
+};
+
+/* Copies n chars from s to *pool as a string. Returns the string. */
+static char *pool_add(char **pool, char const *s, int n) {
+    char *p = *pool;
+    memcpy(p, s, n);
+    p[n] = '\0';
+    *pool += n + 1;
+    return p;
+}
+
+/* Parses the contents of the placeholder with n chars at p into item,
+   copying its argument to *pool. Returns false if it is unknown. */
+static bool parse_placeholder(struct layout_item *item, char const *p,
+                              int n, char **pool) {
+    char const *colon = memchr(p, ':', n);
+    int name_len = colon ? colon - p : n;
+
+    for(unsigned int i = 0; i < NLAYOUT_NAMES; ++i) {
+        char const *name = layout_names[i].name;
+        if((int)strlen(name) != name_len || memcmp(name, p, name_len))
+            continue;
+
+        item->kind = layout_names[i].kind;
+        item->text = colon && n > name_len + 1 ?
+            pool_add(pool, colon + 1, n - name_len - 1) :
+            layout_names[i].arg;
+        item->state = 0;
+        /* A bar needs 1 or 2 fill chars. */
+        return item->kind != ITEM_BAR || strlen(item->text) <= 2;
+    }
+
+    return false;
+}
+
+prgi_layout_t *prgi_layout(char const *format) {
+    /* There are at most strlen(format) + 1 items, and the pool needs
+       space for all chars and their terminators. */
+    int n = strlen(format);
+    struct prgi_layout_t *layout = malloc(sizeof(*layout) +
+                                          (n + 1) * sizeof(layout->items[0]));
+    char const *p = format;
+    char *pool;
+
+    if(!layout) return NULL;
+    layout->pool = pool = malloc(2 * n + 2);
+    if(!pool) {
+        free(layout);
+        return NULL;
+    }
+    layout->nitems = layout->nbars = layout->width = 0;
+
+    while(*p) {
+        struct layout_item *item = &layout->items[layout->nitems++];
+        char const *end;
+
+        item->kind = ITEM_TEXT;
+        if(p[0] == '{' && p[1] == '{') {
+            /* Escaped brace. */
+            item->text = pool_add(&pool, p, 1);
+            p += 2;
+        } else if(p[0] == '{') {
+            end = strchr(p, '}');
+            if(!end || !parse_placeholder(item, p + 1, end - p - 1, &pool)) {
+                prgi_layout_free(layout);
+                return NULL;
+            }
+            if(item->kind == ITEM_BAR) ++layout->nbars;
+            p = end + 1;
+        } else {
+            end = strchr(p + 1, '{');
+            if(!end) end = p + strlen(p);
+            item->text = pool_add(&pool, p, end - p);
+            p = end;
+        }
+
+        if(item->kind == ITEM_TEXT) {
+            item->width = esc_strlen(item->text);
+            layout->width += item->width;
+        }
+    }
+
+    return layout;
+}
+
+void prgi_layout_free(prgi_layout_t *layout) {
+    if(!layout) return;
+    free(layout->pool);
+    free(layout);
+}
+
+/* Formats the field of item in item->buf and sets its width. */
+static void format_item(struct layout_item *item) {
+    struct prgi_snapshot s;
+    char *b = item->buf;
+    int size = sizeof(item->buf);
+
+    switch(item->kind) {
+    case ITEM_PERCENT: percent(b, size, prgi.progress); break;
+    case ITEM_ELAPSED: timehms(b, size, prgi.elapsed); break;
+    case ITEM_REMAINING: timehms(b, size, prgi.remaining); break;
+    case ITEM_RATE: sipref(b, size, prgi.rate); break;
+    case ITEM_MEAN_RATE: sipref(b, size, prgi.mean_rate); break;
+    case ITEM_RATE_SMOOTHED: sipref(b, size, prgi.rate_smoothed); break;
+    case ITEM_BYTE_RATE: binpref(b, size, prgi.rate); break;
+    case ITEM_BYTE_MEAN_RATE: binpref(b, size, prgi.mean_rate); break;
+    case ITEM_REMAINING_SMOOTHED:
+        timehms(b, size, prgi.remaining_smoothed);
+        break;
+    case ITEM_THROBBER:
+        s.count = atomic_load(&global.count);
+        s.total = global.total;
+        b[0] = prgi_throbber_r(item->text, &item->state, &s);
+        b[1] = '\0';
+        break;
+    default:
+        return;
+    }
+    item->width = strlen(b);
+}
+
+void prgi_layout_print(prgi_layout_t *layout) {
+    char line[LINEBUFSIZE];
+    int width = layout->width, len = 0, bar_len = 0;
+
+    if(!valid_terminal()) return;
+
+    /* Each field is formatted once. Then the bars share the space
+       left. */
+    for(int i = 0; i < layout->nitems; ++i) {
+        struct layout_item *item = &layout->items[i];
+        if(item->kind == ITEM_TEXT || item->kind == ITEM_BAR) continue;
+        format_item(item);
+        width += item->width;
+    }
+    if(layout->nbars) {
+        bar_len = (global.width - width) / layout->nbars;
+        /* See bar_render(). */
+        if(bar_len < 10) bar_len = 10;
+        if(bar_len > MAXBARLEN) bar_len = MAXBARLEN;
+        width += layout->nbars * bar_len;
+    }
+
+    for(int i = 0; i < layout->nitems && len < LINEBUFSIZE - 1; ++i) {
+        struct layout_item *item = &layout->items[i];
+        char const *t = item->kind == ITEM_TEXT ? item->text : item->buf;
+        char fill[2];
+
+        if(item->kind == ITEM_BAR) {
+            fill[0] = item->text[0];
+            fill[1] = item->text[1];
+            bar_render(line + len, LINEBUFSIZE - len, prgi.progress,
+                       prgi.elapsed, bar_len, fill, "");
+            len += strlen(line + len);
+        } else {
+            len += snprintf(line + len, LINEBUFSIZE - len, "%s", t);
+        }
+        /* The line is truncated by put_line() if too long. */
+        if(len > LINEBUFSIZE - 1) len = LINEBUFSIZE - 1;
+    }
+
+    put_line(line, width);
+}
+
+/****************************************************************** Layouts ***/
+
+
+/*** prgi_report() ************************************************************/
+
+/* Width of the sparkline printed by prgi_report(). */
+#define SPARKLINE_LEN 60
+
+/* Copies the throughput profile to samples, which must have room for
+   PROFILE_SAMPLES + 1 samples, including the last update if it is not
+   there. Returns the number of samples, which is zero before
+   prgi_init(). */
+static int copy_profile(struct profile_sample *samples) {
+    int n;
+
+    prgi_lock();
+    n = global.nprofile;
+    memcpy(samples, global.profile, n * sizeof(samples[0]));
+    if(n > 0 && global.profile_last.time > samples[n - 1].time)
+        samples[n++] = global.profile_last;
+    prgi_unlock();
+
+    return n;
+}
+
+/* Returns the rate between the samples a and b, or 0 if they were
+   taken at the same time, so that no NaN reaches the sparkline. */
+static float profile_rate(struct profile_sample const *a,
+                          struct profile_sample const *b) {
+    float dt = b->time - a->time;
+    return dt > 0 ? (b->count - a->count) / dt : 0;
+}
+
+static int cmp_floats(void const *a, void const *b) {
+    float x = *(float const *)a, y = *(float const *)b;
+    return (x > y) - (x < y);
+}
+
+void prgi_report(FILE *out) {
+    static struct profile_sample samples[PROFILE_SAMPLES + 1];
+    static float rates[PROFILE_SAMPLES];
+    static char const levels[] = " .:-=+*#%@";
+    char min[32], median[32], p95[32], mean[32], from[32];
+    char line[SPARKLINE_LEN + 1];
+    int n = copy_profile(samples), len, slowest = 0;
+    float max = 0;
+
+    if(n < 2) {
+        fprintf(out, "No throughput profile\n");
+        return;
+    }
+
+    /* Rates in each interval between samples. Intervals have
+       approximately the same durations. */
+    for(int i = 1; i < n; ++i) {
+        rates[i - 1] = profile_rate(&samples[i - 1], &samples[i]);
+        if(rates[i - 1] < rates[slowest]) slowest = i - 1;
+    }
+
+    timehms(from, sizeof(from), samples[slowest].time);
+    sipref(min, sizeof(min), rates[slowest]);
+
+    /* Sparkline with each char showing the rate over a group of
+       intervals, relative to the maximum of the groups. */
+    len = n - 1 < SPARKLINE_LEN ? n - 1 : SPARKLINE_LEN;
+    for(int j = 0; j < len; ++j) {
+        float r = profile_rate(&samples[j * (n - 1) / len],
+                               &samples[(j + 1) * (n - 1) / len]);
+        if(r > max) max = r;
+    }
+    for(int j = 0; j < len; ++j) {
+        float r = profile_rate(&samples[j * (n - 1) / len],
+                               &samples[(j + 1) * (n - 1) / len]);
+        line[j] = levels[max > 0 ? (int)myround(9 * r / max) : 0];
+    }
+    line[len] = '\0';
+
+    qsort(rates, n - 1, sizeof(rates[0]), cmp_floats);
+    sipref(median, sizeof(median), rates[(n - 1) / 2]);
+    sipref(p95, sizeof(p95), rates[(int)(0.95f * (n - 2))]);
+    sipref(mean, sizeof(mean), profile_rate(&samples[0], &samples[n - 1]));
+
+    fprintf(out, "Rate: min %s/s, median %s/s, p95 %s/s, mean %s/s\n",
+            min, median, p95, mean);
+    fprintf(out, "Slowest window: %s/s at %s, lasting %.3gs\n", min, from,
+            samples[slowest + 1].time - samples[slowest].time);
+    fprintf(out, "Profile: [%s]\n", line);
+}
+
+void prgi_report_csv(FILE *out) {
+    static struct profile_sample samples[PROFILE_SAMPLES + 1];
+    char rate[32];
+    int n = copy_profile(samples);
+
+    fprintf(out, "elapsed,count,rate\n");
+    for(int i = 0; i < n; ++i) {
+        /* The rate is the one in the interval ending at the sample. */
+        fprintf(out, "%g,%ld,%s\n", samples[i].time, samples[i].count,
+                i > 0 ? sprn(rate, sizeof(rate), "%g",
+                             profile_rate(&samples[i - 1], &samples[i])) : "");
+    }
+}
+
+/************************************************************ prgi_report() ***/
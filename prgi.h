@@ -23,6 +23,14 @@
 
 #include <threads.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 
 /*** Private symbols **********************************************************/
@@ -30,16 +38,167 @@
 /* Don't use them. They are visible because the inline function
    prgi_update() needs them. See documentation in prgi.c. */
 
+#ifndef PRGI_CACHELINE
+#define PRGI_CACHELINE 64
+#endif
+
+struct prgi_task_t;
+
+/* count and mark are used by prgi_update() at each call and are kept
+   in a cache line of their own, apart from the fields used only by
+   prgi_update__() and from other thread-local variables. */
 struct prgi_thread_state_ {
-    long int total, count, last_count, mark;
-    float last_time;
-};
-extern thread_local struct prgi_thread_state_ prgi_thread_;
+    long int count, mark;
+    unsigned long int tick;
+    long int total __attribute__ ((aligned(PRGI_CACHELINE)));
+    long int last_count, step;
+    float last_time, rate;
+    unsigned long int generation;
+    long int shown_count;
+    float shown_time, shown_rate;
+    struct prgi_task_t *task;
+    int id;
+} __attribute__ ((aligned(PRGI_CACHELINE)));
+#if defined(PRGI_SINGLE_THREAD)
+#define PRGI_THREAD_LOCAL_
+#elif defined(__cplusplus)
+/* C++ thread_local would check for a dynamic initialization at each
+   access. */
+#define PRGI_THREAD_LOCAL_ __thread
+#else
+#define PRGI_THREAD_LOCAL_ thread_local
+#endif
+
+/* State of the calling thread in its current context (see
+   prgi_ctx_use()). It is always the same variable, so that
+   prgi_update() does a single direct TLS access. */
+extern PRGI_THREAD_LOCAL_ struct prgi_thread_state_ prgi_thread_;
+
+#ifdef PRGI_TICK
+/* Incremented by the ticker thread each prgi.update seconds. It is in
+   a cache line of its own, as it is read at each prgi_update(), where
+   a plain load suffices. Both conditions of prgi_due_() are evaluated
+   and or'ed bitwise (the tick as a xor), so that the fast path takes a
+   single branch. */
+struct prgi_tick_ {
+    unsigned long int value;
+} __attribute__ ((aligned(PRGI_CACHELINE)));
+extern struct prgi_tick_ prgi_tick_;
+
+#define prgi_due_(inc)                                                  \
+    (((unsigned long int)((prgi_thread_.count += (inc)) >=              \
+                          prgi_thread_.mark) |                          \
+      (__atomic_load_n(&prgi_tick_.value, __ATOMIC_RELAXED) ^           \
+       prgi_thread_.tick)) != 0)
+#else
+#define prgi_due_(inc) ((prgi_thread_.count += (inc)) >= prgi_thread_.mark)
+#endif
 
 bool prgi_update__(void);
 
 /********************************************************** Private symbols ***/
 
+/* Values for prgi.mark_controller. */
+enum prgi_mark_controller {
+    PRGI_MARK_LINEAR,
+    PRGI_MARK_EWMA,
+    PRGI_MARK_CAPPED,
+};
+
+/* Values for prgi.record_format. */
+enum prgi_record_format {
+    PRGI_RECORD_JSON,
+    PRGI_RECORD_BINARY,
+};
+
+/* Binary record written to prgi.record_fd with the format
+ * PRGI_RECORD_BINARY. magic is PRGI_RECORD_MAGIC and size is
+ * sizeof(struct prgi_record), so readers can validate the stream.
+ * The fields are in the byte order of the machine that wrote them.
+ */
+#define PRGI_RECORD_MAGIC 0x49475250 /* "PRGI" in little endian */
+
+struct prgi_record {
+    uint32_t magic;
+    uint32_t size;
+    int64_t count;
+    int64_t total;
+    float progress;
+    float elapsed;
+    float rate;
+    float mean_rate;
+};
+
+/* Shared memory segment exported with prgi.shm_export. The segment
+ * is named "/prgi.<pid>" (usually found at /dev/shm/prgi.<pid>). The
+ * fields after seq are protected by a sequence lock: seq is odd
+ * while they are being written. A reader must read seq (with acquire
+ * semantics), copy the fields and read seq again, retrying while seq
+ * is odd or has changed. See prgi_top.c.
+ */
+#define PRGI_SHM_MAGIC 0x4d534750 /* "PGSM" in little endian */
+#define PRGI_SHM_VERSION 1
+
+struct prgi_shm {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;
+    int32_t pid;
+    int64_t count;
+    int64_t total;
+    float progress;
+    float elapsed;
+    float remaining;
+    float rate;
+    float mean_rate;
+};
+
+/* Copy of the status fields taken by prgi_snapshot(), formatted by
+ * the reentrant formatters (the ones ending in _r). count and total
+ * are the global work counters at the time of the status update.
+ */
+struct prgi_snapshot {
+    int width;
+    long int count;
+    long int total;
+    float progress;
+    float elapsed;
+    float remaining;
+    float rate;
+    float mean_rate;
+    float rate_smoothed;
+    float remaining_smoothed;
+};
+
+/* Internal counters of prgi returned by prgi_stats(). They are
+ * collected only if prgi.c is compiled with PRGI_STATS defined, and
+ * are zero otherwise. Times are in seconds.
+ *
+ * - slow_calls: calls of the slow path of prgi_update() (when the
+ *   thread crosses its mark).
+ * - updates: slow calls that returned true. The others returned
+ *   false.
+ * - lock_wait and lock_hold: total time waiting for and holding the
+ *   internal lock, in all threads.
+ * - io_time and io_writes: time spent writing frames to the terminal
+ *   (see prgi_puts(), prgi_clear() and prgi_flush_frame()) and number
+ *   of writes.
+ * - status_updates: number of status updates.
+ * - update and period: requested update period (prgi.update) and
+ *   achieved one (mean time between status updates).
+ */
+struct prgi_stats {
+    long int slow_calls;
+    long int updates;
+    double lock_wait;
+    double lock_hold;
+    double io_time;
+    long int io_writes;
+    long int status_updates;
+    float update;
+    float period;
+};
+
 /* prgi_t: struct for the prgi global variable.
  */
 struct prgi_t {
@@ -47,6 +206,19 @@ struct prgi_t {
     FILE *output;
     float update;
     bool lock_on_update;
+    void (*reporter)(void);
+    enum prgi_mark_controller mark_controller;
+    int rate_window;
+    int record_fd;
+    enum prgi_record_format record_format;
+    bool shm_export;
+    bool defer_flush;
+    bool handle_sigwinch;
+    bool lazy_threads;
+    int multibar;
+    char const *aggregate;
+    int rank;
+    void (*io_print)(void);
 
     /* Status fields. */
     int width;
@@ -55,8 +227,14 @@ struct prgi_t {
     float remaining;
     float rate;
     float mean_rate;
+    float rate_smoothed;
+    float remaining_smoothed;
 };
-extern struct prgi_t prgi;
+
+/* prgi is the struct prgi_t of the current context of the calling
+   thread (see prgi_ctx_use()). */
+extern PRGI_THREAD_LOCAL_ struct prgi_t *prgi_current_;
+#define prgi (*prgi_current_)
 
 /*
  * Configuration fields. If needed, change these variables before
@@ -74,6 +252,119 @@ extern struct prgi_t prgi;
  * after prgi_update() returns true and all printing is done. This is
  * only necessary in multithreaded programs if printing of progress
  * may be slow. It should never be necessary.  Default value: false
+ *
+ * prgi.reporter: If not NULL, prgi_init() starts a reporter thread
+ * that updates the status fields each prgi.update seconds and then
+ * calls this function, which should print the progress indicators
+ * with prgi_printf() and the formatters. In this mode, prgi_update()
+ * only increments the counter of the calling thread and always
+ * returns false, so the worker threads never compute or print
+ * progress. The reporter thread holds the lock while prgi.reporter()
+ * runs. Call prgi_done() when the task is finished to stop the
+ * reporter thread. If the thread can't be started, prgi_update()
+ * calls this function when due instead, and still returns false. The
+ * program must be linked with -pthread. Default value: NULL
+ *
+ * prgi.mark_controller: How prgi_update() estimates the amount of
+ * work that will take prgi.update seconds in each thread, based on
+ * the work rate measured since the last estimate.
+ * - PRGI_MARK_LINEAR: use the last measured rate. Best for steady
+ *   work rates.
+ * - PRGI_MARK_EWMA: use an exponentially weighted moving average of
+ *   the measured rates, so that a single fast or slow period has
+ *   less influence on the estimate.
+ * - PRGI_MARK_CAPPED: like PRGI_MARK_LINEAR, but the estimate can at
+ *   most double from one period to the next (it can decrease
+ *   freely). Best for bursty work, where a fast period followed by a
+ *   slow one would otherwise delay the next update by many times
+ *   prgi.update.
+ * Default value: PRGI_MARK_LINEAR
+ *
+ * prgi.rate_window: Number of updates in the sliding window used to
+ * calculate prgi.rate_smoothed and prgi.remaining_smoothed. The
+ * window spans approximately prgi.rate_window * prgi.update
+ * seconds. It is limited to PRGI_RATE_SAMPLES - 1 (31 by default).
+ * Default value: 10
+ *
+ * prgi.record_fd: If not negative, a record with progress, elapsed,
+ * rate, mean_rate, count and total is written to this file
+ * descriptor each time the status fields are updated, with a single
+ * write(). This works even if prgi.output is not a terminal (for
+ * example, in batch jobs with stderr redirected to a file), so that
+ * the progress can be read by programs. Example: prgi.record_fd = 2
+ * Default value: -1
+ *
+ * prgi.record_format: Format of the records written to
+ * prgi.record_fd.
+ * - PRGI_RECORD_JSON: one JSON object per line (JSON lines), with
+ *   undefined values written as null.
+ * - PRGI_RECORD_BINARY: one struct prgi_record per update.
+ * Default value: PRGI_RECORD_JSON
+ *
+ * prgi.shm_export: If set as true, prgi_init() creates a shared
+ * memory segment (struct prgi_shm) where the status fields are
+ * published each time they are updated, so that external monitors
+ * like prgi-top can read them without any I/O by the program. The
+ * segment is removed at program exit, or when its context is freed
+ * (see prgi_ctx_new()). In glibc older than 2.34, the program must be
+ * linked with -lrt.
+ * Default value: false
+ *
+ * prgi.defer_flush: Output of prgi_printf(), prgi_puts() and
+ * prgi_clear() is kept in a frame buffer and written with a single
+ * write(). If this option is false, this is done when the frame has
+ * as many lines as the previous one, so a frame of the same size is
+ * written at once, and after each line printed beyond them (like the
+ * final lines). A frame with fewer lines than the previous one is
+ * written at the next time prgi_update() returns true or by
+ * prgi_done(). If true, the whole frame is written only when
+ * prgi_flush_frame() is called or at the next time prgi_update()
+ * returns true. In this case, call prgi_flush_frame() after the final
+ * lines are printed. Default value: false
+ *
+ * prgi.handle_sigwinch: If set as true, prgi_init() installs a
+ * handler for SIGWINCH (which is sent when the terminal is resized)
+ * and the terminal width is queried only after the signal is
+ * received, instead of at every update. A previously installed
+ * handler is still called by prgi's handler. Set as false in
+ * programs that need full control of their signal handlers.
+ * Default value: true
+ *
+ * prgi.lazy_threads: If set as true, threads don't need to call
+ * prgi_init_thread(). Each thread attaches itself to the current
+ * task at its first call of prgi_update() after prgi_init(), which
+ * must take the whole work as argument. As the share of work of each
+ * thread is not needed, this is suited to OpenMP loops with
+ * dynamic or guided schedules (see example_openmp.c), whose threads
+ * may outlive the task and be reused in the next one. Call
+ * prgi_done() after the loop to show the final state.
+ * Default value: false
+ *
+ * prgi.multibar: If greater than zero, the threads are registered so
+ * that prgi_multibar() can print one line for each of them, using at
+ * most prgi.multibar lines. Default value: 0
+ *
+ * prgi.aggregate and prgi.rank: If prgi.aggregate is not NULL, the
+ * progress of several processes (ranks, like in MPI) running the same
+ * task is aggregated in the process with prgi.rank equal to 0, which
+ * prints it. prgi.aggregate is the address "host:port" to which rank
+ * 0 binds an UDP socket (host may be empty for any address) and to
+ * which the other ranks, identified by prgi.rank (from 1 to
+ * PRGI_MAXRANKS - 1, defined in prgi.c), send their counters each
+ * prgi.update seconds without ever blocking. In the other ranks,
+ * prgi_update() never returns true and the reporter thread is not
+ * started. Rank 0 should wait for the other ranks, possibly using the
+ * reporter thread, and call prgi_done() at the end. All ranks must
+ * call prgi_init() the same number of times and run on machines with
+ * the same byte order. The socket is opened at the first prgi_init().
+ * See example_ranks.c. Default values: NULL and 0
+ *
+ * prgi.io_print: Function called by the I/O wrappers (see prgi_read())
+ * when prgi_update() returns true, which should print the progress
+ * indicators like the code following prgi_update() does. If
+ * prgi.lock_on_update is true, the wrappers call prgi_unlock()
+ * after it. If NULL, the wrappers print nothing, which is the case
+ * in reporter mode (see prgi.reporter). Default value: NULL
  */
 
 
@@ -92,6 +383,175 @@ void prgi_init(long int total);
 void prgi_init_thread(long int total);
 
 
+/* Adds delta to the total work, for programs that discover work
+ * while they run (for example, walking a directory tree). It can be
+ * called from any thread, after prgi_init() and prgi_init_thread(),
+ * and never takes the lock. delta is also added to the current task
+ * of the calling thread (see prgi_task_begin()).
+ *
+ * While the total is zero or less, it is unknown: prgi.progress,
+ * prgi.remaining and prgi.remaining_smoothed are NaN, prgi_percent()
+ * shows "?%" and the progress bars show a segment bouncing from one
+ * end to the other. Rates are not affected. So prgi_init(0) followed
+ * by calls to prgi_update() shows an indeterminate progress.
+ */
+void prgi_add_total(long int delta);
+
+
+/* For long-lived worker threads running many short jobs, as in a
+ * thread pool. prgi_thread_attach() adds total, the work of the job,
+ * to the total work (like prgi_add_total()). It initializes the
+ * calling thread the first time it is called in a task, as
+ * prgi_init_thread(0), and never takes the lock afterwards.
+ * prgi_thread_detach() accounts for the work done by the thread since
+ * its last due update, so the progress shown is accurate when a job
+ * ends, even if it lasted less than prgi.update. It takes the lock
+ * briefly, so that the reporter thread does not count the work twice
+ * while it is moved to the global counter. The end of a job is not a
+ * mark, so the thread is not shown by prgi_multibar(). See
+ * example_pool.c.
+ */
+void prgi_thread_attach(long int total);
+void prgi_thread_detach(void);
+
+
+/* Accounts for the work done so far and updates the status fields for
+ * the last time. If the reporter thread is running (see
+ * prgi.reporter), calls prgi.reporter() a last time and stops the
+ * reporter thread. Call it in the main thread after all worker
+ * threads finished and before printing the final lines.
+ */
+void prgi_done(void);
+
+
+/* Prints to out a summary of the work rate along the task, to find
+ * slowdowns hidden by prgi.mean_rate: the minimum, median, 95th
+ * percentile and mean of the rates measured between the samples of
+ * the throughput profile, the slowest interval and a sparkline of
+ * the rate along the task, like
+ *
+ * Rate: min 120M/s, median 311M/s, p95 320M/s, mean 298M/s
+ * Slowest window: 120M/s at 4s, lasting 0.2s
+ * Profile: [@@@@@@@@%%@@@@@@@@=-::-=@@@@@@@@@@@@@@@@@@@@@@@@]
+ *
+ * The profile holds the time and count of the updates of the status
+ * fields since prgi_init(). When PRGI_PROFILE_SAMPLES (defined in
+ * prgi.c, 512 by default) samples are recorded, every other sample
+ * is dropped and from then on only half of the updates are
+ * recorded, so it spans the whole task with bounded memory. Call it
+ * after prgi_done().
+ */
+void prgi_report(FILE *out);
+
+/* Like prgi_report(), but prints the samples of the throughput
+ * profile as CSV with the columns elapsed, count and rate (the rate
+ * since the previous sample).
+ */
+void prgi_report_csv(FILE *out);
+
+
+/*
+ * Tasks.
+ *
+ * A task is a part of the total work with its own total and counter,
+ * for example a stage of a pipeline. Tasks may be nested: the total
+ * of a task is added to the totals of its parent and of all its
+ * ancestors, and the work counted in a task is also counted in its
+ * ancestors. Top level tasks are part of the global progress
+ * reported in the prgi status fields, so prgi.elapsed and
+ * prgi.mean_rate are continuous across the tasks. A NULL task
+ * refers to the global progress.
+ *
+ * The work counted by prgi_update() in a thread goes to the current
+ * task of that thread. Tasks are updated at the same time as the
+ * global counter, so prgi_update() is not affected by tasks. In
+ * reporter mode (see prgi.reporter), the work of registered threads
+ * is added to their tasks only when prgi_task_use() or
+ * prgi_task_end() is called.
+ */
+typedef struct prgi_task_t prgi_task_t;
+
+/* Begins a task with the given total as a child of parent (which
+ * may be NULL for a top level task) and makes it the current task of
+ * the calling thread. label is a description of the task that can be
+ * retrieved by prgi_task_label() and must remain valid until the task
+ * ends. Returns NULL if the task could not be allocated, in which
+ * case the work is accounted only to the global progress.
+ */
+prgi_task_t *prgi_task_begin(prgi_task_t *parent, long int total,
+                             char const *label);
+
+/* Makes task the current task of the calling thread. This is used by
+ * threads working on a task begun by another thread.
+ */
+void prgi_task_use(prgi_task_t *task);
+
+/* Ends the task. If it is the current task of the calling thread,
+ * its parent becomes the current task. No thread may be using task
+ * when it ends.
+ */
+void prgi_task_end(prgi_task_t *task);
+
+/* Returns the progress of task, from 0 (0%) to 1 (100%). */
+float prgi_task_progress(prgi_task_t const *task);
+
+/* Returns the label of task. */
+char const *prgi_task_label(prgi_task_t const *task);
+
+
+/*
+ * Contexts.
+ *
+ * A context is an independent instance of prgi, with its own
+ * configuration and status fields (the struct prgi), lock, counters,
+ * threads and output, so that subsystems of a program (for example,
+ * two libraries) can report their progress without interfering with
+ * each other. All prgi functions, the struct prgi and prgi_update()
+ * act on the current context of the calling thread, which is
+ * initially the default context. The default context always exists,
+ * so programs that don't use contexts are not affected.
+ *
+ * Each thread has its own state in each context, so a thread may
+ * switch between contexts at any time, for example:
+ *
+ * prgi_ctx_t *prev = prgi_ctx_use(my_ctx);
+ * prgi_init(total);
+ * ... loop calling prgi_update() ...
+ * prgi_done();
+ * prgi_ctx_use(prev);
+ *
+ * Worker threads must make the context current before calling
+ * prgi_init_thread() and prgi_update(). prgi_printf(), prgi_bar(),
+ * prgi_bartxt() and prgi_multibar() use buffers of the context, but
+ * the other formatters write to static buffers shared by all
+ * contexts, so the _r formatters should be used for them if several
+ * contexts print at the same time. With
+ * PRGI_TICK, the ticker thread is shared by all contexts and follows
+ * the prgi.update of the last context initialized.
+ */
+typedef struct prgi_ctx_t prgi_ctx_t;
+
+/* Creates a context with the default configuration. Returns NULL if
+ * there is no memory or if there are already PRGI_MAXCTX contexts
+ * (defined in prgi.c, 8 by default), including the default one.
+ */
+prgi_ctx_t *prgi_ctx_new(void);
+
+/* Frees a context created by prgi_ctx_new(). Its task must be done
+ * (see prgi_done()) and it must not be the current context of any
+ * other thread. If it is the current context of the calling thread,
+ * the default context becomes current.
+ */
+void prgi_ctx_free(prgi_ctx_t *ctx);
+
+/* Makes ctx the current context of the calling thread, or the default
+ * context if ctx is NULL. Returns the previous current context (NULL
+ * for the default context). It takes the locks of both contexts, so
+ * it should not be called in inner loops.
+ */
+prgi_ctx_t *prgi_ctx_use(prgi_ctx_t *ctx);
+
+
 /* prgi_update() increments the internal work counter by 'inc'. This
  * increment is the amount of work done since the last time
  * prgi_update() was called.
@@ -99,6 +559,7 @@ void prgi_init_thread(long int total);
  * Returns true each prgi.update seconds (approximately). When it
  * returns true, the status fields in the struct prgi are ready to be
  * directly read or printed in convenient form by the formatters.
+ * Other threads may read them at any time with prgi_snapshot().
  *
  * This is a very lightweith function that can be called billions of
  * times per second without causing significant overhead to the
@@ -109,21 +570,126 @@ void prgi_init_thread(long int total);
  *
  * Normally, prgi_update() is an inline function. If PRGI_UPDATE_MACRO
  * is defined, it will be a preprocessor macro.
+ *
+ * If PRGI_SINGLE_THREAD is defined, the thread state is a plain global
+ * variable instead of a thread-local one and prgi does no locking, so
+ * prgi_update() avoids the TLS access (which may be a function call in
+ * shared libraries). prgi can then be used by a single thread and no
+ * reporter thread is started: prgi.reporter is called by prgi_update()
+ * when due, which then returns false. PRGI_SINGLE_THREAD must be defined both
+ * when compiling prgi.c and the code including prgi.h.
+ *
+ * If PRGI_TICK is defined (also for both prgi.c and the code including
+ * prgi.h), the time to update is not estimated from the work rate.
+ * Instead, prgi_init() starts a ticker thread that increments a
+ * counter each prgi.update seconds and prgi_update() also checks if
+ * the counter changed since the last update of the thread, so every
+ * thread accounts its work at each tick and the first one to see the
+ * tick prints. The threads never read the clock unless they print,
+ * and the update period is kept exactly even if the time per unit of
+ * work varies a lot. The program must be linked with -pthread.
+ *
+ * C++ programs may include prgi.hpp instead, whose prgi::tracker
+ * keeps the counter of prgi_update() out of the thread-local state.
  */
 #ifndef PRGI_UPDATE_MACRO
 
 static inline __attribute__ ((always_inline)) bool prgi_update(long int inc) {
-    return (prgi_thread_.count += inc) >= prgi_thread_.mark && prgi_update__();
+    return prgi_due_(inc) && prgi_update__();
 }
 
 #else
 
-#define prgi_update(inc)                                                \
-    ((prgi_thread_.count += (inc)) >= prgi_thread_.mark && prgi_update__())
+#define prgi_update(inc) (prgi_due_(inc) && prgi_update__())
 
 #endif
 
 
+/*
+ * Chunked loops.
+ *
+ * Calling prgi_update(1) for each element in an inner loop prevents
+ * its vectorization, as the thread state is modified at each
+ * iteration. Instead, the loop can be split in chunks with no calls
+ * to prgi, calling prgi_update() once per chunk with the size of the
+ * chunk. prgi_chunk(max) returns the size of the next chunk: the
+ * work left until prgi_update() returns true again, but not more
+ * than max (nor less than 1). This way, a chunk ends exactly when
+ * the update is due, and max only bounds its size.
+ *
+ * PRGI_FOR_CHUNKED(begin, end, n, max) loops over the chunks of the
+ * range 0 <= i < n, declaring the long int variables begin and end
+ * with the limits of each chunk:
+ *
+ * PRGI_FOR_CHUNKED(i0, i1, N, 4096) {
+ *     for(long int i = i0; i < i1; i++)
+ *         s += x[i] * y[i];
+ *     if(prgi_update(i1 - i0))
+ *         prgi_printf("%s [%s]", prgi_percent(), prgi_bar(0, "#."));
+ * }
+ */
+static inline long int prgi_chunk(long int max) {
+    long int left = prgi_thread_.mark - prgi_thread_.count;
+    if(left > max) left = max;
+    return left < 1 ? 1 : left;
+}
+
+/* End of the chunk starting at begin of the range 0 <= i < n. */
+static inline long int prgi_chunk_end_(long int begin, long int n,
+                                       long int max) {
+    return begin + prgi_chunk(n - begin < max ? n - begin : max);
+}
+
+#define PRGI_FOR_CHUNKED(begin, end, n, max)                              \
+    for(long int begin = 0, end = prgi_chunk_end_(0, (n), (max));         \
+        begin < (n);                                                      \
+        begin = end, end = prgi_chunk_end_(end, (n), (max)))
+
+
+/*
+ * I/O loops.
+ *
+ * For loops scanning files, the work can be counted in bytes, shown
+ * with prgi_byte_rate() and prgi_byte_mean_rate(). prgi_read() and
+ * prgi_fread() are like read() and fread(), also counting the bytes
+ * read with prgi_update(). When it returns true, they call
+ * prgi.io_print(). The error handling is that of read() and
+ * fread(). Example (with a reporter thread, see prgi.reporter):
+ *
+ * prgi_init_fd(fd);
+ * while((n = prgi_read(fd, buf, sizeof(buf))) > 0)
+ *     process(buf, n);
+ * prgi_done();
+ */
+
+/* Like prgi_init(), taking as total the number of bytes from the
+ * current offset to the end of the file open as fd, or an unknown
+ * total (see prgi_add_total()) if fd is not a regular file. For a
+ * FILE, call prgi_init_fd(fileno(stream)) before reading from it.
+ */
+void prgi_init_fd(int fd);
+
+ssize_t prgi_read(int fd, void *buf, size_t n);
+
+size_t prgi_fread(void *ptr, size_t size, size_t n, FILE *stream);
+
+/* Like prgi_update(), but takes as argument the work done so far in
+ * the calling thread, since prgi_init() or prgi_init_thread(),
+ * instead of the increment. For a file mapped by mmap(), pos can be
+ * the offset reached in the mapping, so the progress is reported
+ * without touching the pages (not with prgi.lazy_threads):
+ *
+ * for(char *p = map; p < map + size; p += 4096) {
+ *     scan_page(p);
+ *     if(prgi_update_pos(p - map))
+ *         prgi_printf("%s %s", prgi_percent(), prgi_byte_rate());
+ * }
+ */
+static inline bool prgi_update_pos(long int pos) {
+    return prgi_update(pos - prgi_thread_.count);
+}
+
+
 /*
  * Formatting functions.
  *
@@ -137,7 +703,8 @@ static inline __attribute__ ((always_inline)) bool prgi_update(long int inc) {
  */
 
 /* Returns a string with the percentage progress with '%' sign.
- * Raw value: prgi.progress (taking values from 0 (0%) to 1 (100%).
+ * Raw value: prgi.progress (taking values from 0 (0%) to 1 (100%), or
+ * NaN if the total is unknown, see prgi_add_total()).
  */
 char *prgi_percent(void);
 
@@ -165,6 +732,28 @@ char *prgi_rate(void);
  */
 char *prgi_mean_rate(void);
 
+/* Like prgi_rate(), but the rate is averaged over the last
+ * prgi.rate_window updates, so it is less noisy.
+ * Raw value: prgi.rate_smoothed
+ */
+char *prgi_rate_smoothed(void);
+
+/* Like prgi_rate() and prgi_mean_rate() for work counted in bytes,
+ * with binary prefixes (powers of 1024) and the unit, like 512B/s,
+ * 1.50KiB/s and 231MiB/s.
+ */
+char *prgi_byte_rate(void);
+char *prgi_byte_mean_rate(void);
+
+/* Like prgi_remaining(), but the estimate is based on
+ * prgi.rate_smoothed, so it is more stable.
+ * Raw value: prgi.remaining_smoothed
+ */
+char *prgi_remaining_smoothed(void);
+
+/* Fill of prgi_bar() for bars drawn with Unicode blocks. */
+#define PRGI_BLOCKS "\x01"
+
 /* Returns a string with a progress bar with length len. If len = 0,
  * then the length is automatic, taking all the available space in the
  * terminal width.
@@ -180,6 +769,13 @@ char *prgi_mean_rate(void);
  * printed in reverse video Using ANSI escape sequences. This is the
  * preferred way for prgi_bartxt() below.
  *
+ * If fill is PRGI_BLOCKS, the completed part is drawn with Unicode
+ * block elements, with a resolution of 1/8 of a char. The terminal
+ * must support UTF-8. No text is placed inside such bar.
+ *
+ * If the total is unknown (see prgi_add_total()), a filled segment
+ * bounces in the bar.
+ *
  * Raw value: prgi.progress.
  */
 char *prgi_bar(int len, char const *fill);
@@ -207,6 +803,54 @@ char *prgi_bartxt(int len, char const *fill, char const *format, ...);
  */
 int prgi_throbber(char const *anim);
 
+/*
+ * Reentrant formatters.
+ *
+ * The formatters above share static buffers, so they can't be used
+ * from more than one thread at the same time. The following ones
+ * format the fields of a snapshot taken by prgi_snapshot() into the
+ * caller-supplied buffer buf of the given size and return buf. The
+ * output is truncated to fit in size. They can be called from any
+ * thread, at any time, and keep no state between calls.
+ */
+
+/* Copies the status fields from the last status update to out. The
+ * copy is consistent (all fields come from the same update) and is
+ * taken without locking, so it can be called from any thread at any
+ * rate, like a GUI or monitoring thread, without slowing the threads
+ * calling prgi_update().
+ */
+void prgi_snapshot(struct prgi_snapshot *out);
+
+char *prgi_percent_r(char *buf, size_t size, struct prgi_snapshot const *s);
+char *prgi_remaining_r(char *buf, size_t size, struct prgi_snapshot const *s);
+char *prgi_elapsed_r(char *buf, size_t size, struct prgi_snapshot const *s);
+char *prgi_rate_r(char *buf, size_t size, struct prgi_snapshot const *s);
+char *prgi_mean_rate_r(char *buf, size_t size, struct prgi_snapshot const *s);
+char *prgi_rate_smoothed_r(char *buf, size_t size,
+                           struct prgi_snapshot const *s);
+char *prgi_byte_rate_r(char *buf, size_t size, struct prgi_snapshot const *s);
+char *prgi_byte_mean_rate_r(char *buf, size_t size,
+                            struct prgi_snapshot const *s);
+char *prgi_remaining_smoothed_r(char *buf, size_t size,
+                                struct prgi_snapshot const *s);
+
+/* Like prgi_bar() and prgi_bartxt(), with txt placed at the center of
+ * the bar. If len <= 0, the bar takes the width of the terminal
+ * stored in the snapshot. Unlike prgi_bar(), the length is not shared
+ * with other fields of a line.
+ */
+char *prgi_bar_r(char *buf, size_t size, struct prgi_snapshot const *s,
+                 int len, char const *fill);
+char *prgi_bartxt_r(char *buf, size_t size, struct prgi_snapshot const *s,
+                    int len, char const *fill, char const *txt);
+
+/* Like prgi_throbber(), keeping the position in anim in *state, which
+ * must be initialized with 0.
+ */
+int prgi_throbber_r(char const *anim, unsigned int *state,
+                    struct prgi_snapshot const *s);
+
 
 /*
  * Prints a progress indicator line with a printf-like syntax. This
@@ -229,6 +873,85 @@ int prgi_throbber(char const *anim);
 __attribute__ ((format(printf, 1, 2)))
 void prgi_printf(char const *format, ...);
 
+
+/* Queues a log message, with a printf-like syntax, to be printed
+ * above the progress lines at the beginning of the next frame (or at
+ * prgi_done()), in the same write() that redraws them. Unlike
+ * printing to prgi.output directly, this keeps the lines of prgi in
+ * place. It can be called from any thread at any time: it never
+ * takes the lock nor writes to the terminal. Messages longer than
+ * PRGI_LOG_LEN - 1 chars are truncated, and messages beyond
+ * PRGI_LOG_SLOTS pending ones are dropped and counted in a note
+ * (both defined in prgi.c, 256 and 64 by default). A final line break
+ * is optional.
+ */
+__attribute__ ((format(printf, 1, 2)))
+void prgi_log(char const *format, ...);
+
+/* Prints one line with a progress bar, percentage, rate and remaining
+ * time for each thread initialized with prgi_init_thread() (or
+ * attached, see prgi.lazy_threads) with work to do, like
+ *
+ *  2  47% [##########..........] 61.2M/s 00:00:04
+ *
+ * where 2 is the index of the thread among the initialized ones, in
+ * the order they were registered in the task. It does not change when
+ * other threads exit.
+ * Threads are listed from the least to the most
+ * progressed, so a slow thread is always visible. If there are more
+ * than prgi.multibar threads, the last line is "+K more threads".
+ * prgi.multibar must be set before prgi_init() and the threads are
+ * initialized. It should be called like prgi_printf(), and may be
+ * combined with it.
+ */
+void prgi_multibar(void);
+
+/*
+ * Layouts.
+ *
+ * A layout is a format for a progress line compiled once by
+ * prgi_layout(), which may be printed by prgi_layout_print() instead
+ * of prgi_printf() each time prgi_update() returns true. Each field
+ * is formatted only once, without measuring the line twice as
+ * prgi_printf() does for automatic bars, so printing a layout is
+ * cheaper. The format has placeholders between braces (use "{{" for
+ * a literal brace):
+ *
+ * {percent}, {elapsed}, {remaining} (or {eta}), {rate}, {mean_rate},
+ * {rate_smoothed}, {remaining_smoothed}, {byte_rate},
+ * {byte_mean_rate}: like the corresponding formatters.
+ *
+ * {bar} or {bar:fill}: a progress bar taking the available space, as
+ * prgi_bar(0, fill). The default fill is "#.". The available space
+ * is shared by all bars.
+ *
+ * {throbber} or {throbber:anim}: like prgi_throbber(anim). The
+ * default anim is "|/-\".
+ *
+ * Example:
+ * prgi_layout_t *layout = prgi_layout("{percent} [{bar}] {rate}/s {eta}");
+ * ...
+ * if(prgi_update(1)) prgi_layout_print(layout);
+ */
+typedef struct prgi_layout_t prgi_layout_t;
+
+/* Compiles format into a layout. Returns NULL if format has an
+ * unknown placeholder or if there is no memory.
+ */
+prgi_layout_t *prgi_layout(char const *format);
+
+/* Prints a line with the layout, like prgi_printf(). */
+void prgi_layout_print(prgi_layout_t *layout);
+
+/* Frees the layout. */
+void prgi_layout_free(prgi_layout_t *layout);
+
+/* Writes the lines printed by prgi_printf() and prgi_puts() that are
+ * kept in the frame buffer. This is needed only if prgi.defer_flush
+ * is true.
+ */
+void prgi_flush_frame(void);
+
 /* Clears all lines previously printed by prgi_printf() or
    prgi_puts(). It is not needed after prgi_update(), as it also
    clears the lines before new lines are printed. It is used to print
@@ -241,13 +964,15 @@ void prgi_clear(void);
  * This is a lower level print function that does not allow formatting
  * like prgi_printf(). Printed lines are automatically separated by
  * newlines and lines too big are truncated and appended with ">>>".
+ * Lines equal to the ones printed in the same position at the last
+ * update are not written again.
  */
 void prgi_puts(char const *s);
 
 
 /* prgi.width reports the terminal width. It is updated when
- * prgi_update() returns true. This can be useful for custom printing
- * functions.
+ * prgi_update() returns true (see also prgi.handle_sigwinch). This
+ * can be useful for custom printing functions.
  */
 
 
@@ -257,4 +982,14 @@ void prgi_puts(char const *s);
  */
 void prgi_unlock(void);
 
+
+/* Copies the internal counters of prgi since prgi_init() to out (see
+ * struct prgi_stats).
+ */
+void prgi_stats(struct prgi_stats *out);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* PRGI_H */
@@ -0,0 +1,202 @@
+/*
+ * prgi: C++ header file.
+ *
+ * Copyright (C) 2023  Joao Luis Meloni Assirati.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Header-only C++ wrapper of prgi. prgi.c is still compiled as C and
+ * linked to the program, and all the functions of prgi.h remain
+ * available.
+ *
+ * The namespace prgi hides the macro prgi of prgi.h, so in C++ the
+ * configuration and status fields are accessed as prgi::config().
+ * For example:
+ *
+ *     prgi::config().update = 0.5;
+ *     prgi::scope task(n);
+ *     prgi::tracker<> t;
+ *     for(long int i = 0; i < n; i++) {
+ *         ...
+ *         if(t.update(1))
+ *             prgi_printf("%s [%s]", prgi_percent(), prgi_bar(0, "#."));
+ *     }
+ *
+ * See example_cpp.cpp.
+ */
+
+#ifndef PRGI_HPP
+#define PRGI_HPP
+
+#include <limits>
+#include <type_traits>
+
+#include "prgi.h"
+
+#undef prgi
+
+namespace prgi {
+
+/* The struct prgi_t of the current context of the calling thread,
+ * which is the prgi of C code.
+ */
+inline prgi_t &config() {
+    return *prgi_current_;
+}
+
+
+/*
+ * RAII wrappers.
+ *
+ * scope calls prgi_init(total) when constructed and prgi_done() when
+ * destroyed, so the final state is accounted even if the task is
+ * left by an exception. The final lines must then be printed after
+ * the scope. thread_scope does the same with prgi_thread_attach() and
+ * prgi_thread_detach(), for the jobs run by the workers of a thread
+ * pool.
+ */
+class scope {
+public:
+    explicit scope(long int total) { prgi_init(total); }
+    ~scope() { prgi_done(); }
+    scope(scope const &) = delete;
+    scope &operator=(scope const &) = delete;
+};
+
+class thread_scope {
+public:
+    explicit thread_scope(long int total) { prgi_thread_attach(total); }
+    ~thread_scope() { prgi_thread_detach(); }
+    thread_scope(thread_scope const &) = delete;
+    thread_scope &operator=(thread_scope const &) = delete;
+};
+
+
+/*
+ * Sinks, called by tracker::update() when it returns true. A sink is
+ * any class with an operator()() printing the state, and it is
+ * called statically, so it can be inlined.
+ */
+
+/* Prints nothing, for code that prints when update() returns true, as
+ * with prgi_update(). This is the default sink.
+ */
+struct null_sink {
+    void operator()() const {}
+};
+
+/* Prints the percentage, a progress bar, the rate and the remaining
+ * time, as example_tutorial.c does.
+ */
+struct line_sink {
+    void operator()() const {
+        prgi_printf("%s [%s] Speed: %s/s, Remaining: %s", prgi_percent(),
+                    prgi_bar(0, "#."), prgi_rate(), prgi_remaining());
+    }
+};
+
+
+/*
+ * tracker is the C++ counterpart of prgi_update(). The count and the
+ * mark of the thread state are copied into the tracker, so a tracker
+ * living on the stack of a worker thread keeps them in registers and
+ * update() does not access the thread-local state until the mark is
+ * reached. The work is then flushed to the thread state and
+ * prgi_update__() is called, with the same semantics as prgi_update():
+ * the work is accounted at each due update and the status fields are
+ * ready when update() returns true.
+ *
+ * Counter is the type of the increments. It must be a signed integer
+ * type; with a type narrower than long, the distance to the next mark
+ * is clamped to its maximum. Sink is called when update() returns
+ * true (see null_sink).
+ *
+ * The work done since the last due update is copied back to the
+ * thread state when the tracker is destroyed or flush() is called.
+ * Before that, the reporter thread (see prgi.reporter) does not see
+ * it, so use prgi_update() in reporter mode. Only one tracker per
+ * thread should be alive at a time.
+ */
+template <class Counter = long int, class Sink = null_sink>
+class tracker : private Sink {
+    static_assert(std::is_integral<Counter>::value &&
+                  std::is_signed<Counter>::value,
+                  "Counter must be a signed integer type");
+
+public:
+    explicit tracker(Sink const &sink = Sink()) : Sink(sink) { load(); }
+    ~tracker() { flush(); }
+    tracker(tracker const &) = delete;
+    tracker &operator=(tracker const &) = delete;
+
+    inline __attribute__ ((always_inline)) bool update(Counter inc) {
+#ifndef PRGI_TICK
+        if((left_ -= inc) > 0) return false;
+#else
+        /* A single branch, as in prgi_due_(). */
+        if(!((unsigned long int)((left_ -= inc) <= 0) |
+             (__atomic_load_n(&prgi_tick_.value, __ATOMIC_RELAXED) ^
+              tick_)))
+            return false;
+#endif
+        return update_();
+    }
+
+    /* Copies the work done since the last due update to the thread
+     * state, for example before calling prgi_thread_detach().
+     */
+    void flush() {
+        prgi_thread_.count += long(start_) - long(left_);
+        load();
+    }
+
+private:
+    /* Distance to the mark of the thread when the state was loaded,
+       and its remainder. */
+    Counter start_, left_;
+#ifdef PRGI_TICK
+    unsigned long int tick_;
+#endif
+
+    void load() {
+        long int left = prgi_thread_.mark - prgi_thread_.count;
+        long int max = std::numeric_limits<Counter>::max();
+        start_ = left_ = Counter(left < max ? left : max);
+#ifdef PRGI_TICK
+        tick_ = prgi_thread_.tick;
+#endif
+    }
+
+    /* Out of line, so that update() stays small. */
+    __attribute__ ((noinline)) bool update_() {
+        bool ready;
+
+        prgi_thread_.count += long(start_) - long(left_);
+        /* The mark was beyond the range of Counter. */
+        if(!prgi_due_(0)) {
+            load();
+            return false;
+        }
+        ready = prgi_update__();
+        load();
+        if(ready) static_cast<Sink &>(*this)();
+        return ready;
+    }
+};
+
+} /* namespace prgi */
+
+#endif /* PRGI_HPP */
@@ -0,0 +1,189 @@
+/*
+ * prgi: monitor of programs exporting progress in shared memory.
+ *
+ * Copyright (C) 2023  Joao Luis Meloni Assirati.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * prgi-top shows the progress of all programs in this machine that
+ * use prgi with prgi.shm_export set as true (see prgi.h). It only
+ * reads the shared memory segments /dev/shm/prgi.<pid>, so it costs
+ * nothing to the monitored programs.
+ *
+ * Usage: prgi-top [-1] [-d seconds]
+ * -1: print the table once and exit.
+ * -d: refresh period (default: 1 second).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "prgi.h"
+
+#define SHMDIR "/dev/shm"
+
+/* Number of attempts of read_shm(). An update takes less than a
+   microsecond, so a segment still being written after them belongs
+   to a program that died (or was stopped) in the middle of one. */
+#define SHM_RETRIES 1000
+
+/* Copies the fields of the segment s to *out using the sequence lock
+   (see struct prgi_shm in prgi.h). Returns false if no consistent
+   copy was obtained in SHM_RETRIES attempts. */
+static bool read_shm(struct prgi_shm const *s, struct prgi_shm *out) {
+    uint32_t seq;
+
+    for(int i = 0; i < SHM_RETRIES; ++i) {
+        seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if(seq & 1) continue;
+        memcpy(out, s, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq) return true;
+    }
+    return false;
+}
+
+/* Prints t (in seconds) in buf like 1h02m, or "?" if it is invalid. */
+static char *hms(char *buf, int size, float t) {
+    int n = t;
+
+    if(!isfinite(t) || t < 0) snprintf(buf, size, "?");
+    else if(n < 60) snprintf(buf, size, "%ds", n);
+    else if(n < 3600) snprintf(buf, size, "%dm%02ds", n / 60, n % 60);
+    else snprintf(buf, size, "%dh%02dm", n / 3600, n / 60 % 60);
+    return buf;
+}
+
+/* Prints x in buf with SI prefixes, or "?" if it is invalid. */
+static char *si(char *buf, int size, double x) {
+    char const *p = " KMGTPE";
+
+    if(!isfinite(x) || x < 0) return snprintf(buf, size, "?"), buf;
+    while(x >= 1000 && p[1]) {
+        x /= 1000;
+        ++p;
+    }
+    snprintf(buf, size, "%.3g%c", x, *p);
+    return buf;
+}
+
+/* Reads the command name of process pid. */
+static char *comm(char *buf, int size, int pid) {
+    char path[64];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+    f = fopen(path, "r");
+    if(!f || !fgets(buf, size, f)) snprintf(buf, size, "?");
+    if(f) fclose(f);
+    buf[strcspn(buf, "\n")] = '\0';
+    return buf;
+}
+
+/* Prints one line of the table for the segment file name. */
+static void show(char const *name) {
+    char path[300], cmd[32], elapsed[16], remaining[16], rate[16];
+    struct prgi_shm *s, v;
+    struct stat st;
+    bool alive, consistent;
+    int fd;
+
+    snprintf(path, sizeof(path), SHMDIR "/%s", name);
+    fd = open(path, O_RDONLY);
+    if(fd < 0) return;
+    /* Reading the pages of a truncated segment would raise SIGBUS. */
+    if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(*s)) {
+        close(fd);
+        return;
+    }
+    s = mmap(NULL, sizeof(*s), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(s == MAP_FAILED) return;
+
+    consistent = read_shm(s, &v);
+    munmap(s, sizeof(*s));
+    if(!consistent) {
+        printf("%8s %-16s (stale/torn)\n", name + 5, "?");
+        return;
+    }
+    if(v.magic != PRGI_SHM_MAGIC || v.version != PRGI_SHM_VERSION) return;
+
+    alive = kill(v.pid, 0) == 0 || errno == EPERM;
+    printf("%8d %-16s %5.1f%% %12lld %12lld %9s %9s %9s%s\n",
+           (int)v.pid, alive ? comm(cmd, sizeof(cmd), v.pid) : "(exited)",
+           100 * v.progress, (long long)v.count, (long long)v.total,
+           hms(elapsed, sizeof(elapsed), v.elapsed),
+           hms(remaining, sizeof(remaining), v.remaining),
+           si(rate, sizeof(rate), v.rate), alive ? "" : " *");
+}
+
+static void show_all(void) {
+    struct dirent *e;
+    DIR *d;
+
+    printf("%8s %-16s %6s %12s %12s %9s %9s %9s\n", "PID", "COMMAND",
+           "PROG", "COUNT", "TOTAL", "ELAPSED", "REMAIN", "RATE/s");
+
+    d = opendir(SHMDIR);
+    if(!d) return;
+    while((e = readdir(d))) {
+        if(strncmp(e->d_name, "prgi.", 5) == 0) show(e->d_name);
+    }
+    closedir(d);
+}
+
+int main(int argc, char **argv) {
+    bool once = false;
+    float delay = 1;
+    struct timespec t;
+    int opt;
+
+    while((opt = getopt(argc, argv, "1d:")) != -1) {
+        switch(opt) {
+        case '1': once = true; break;
+        case 'd': delay = atof(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-1] [-d seconds]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(once) {
+        show_all();
+        return 0;
+    }
+
+    t.tv_sec = delay;
+    t.tv_nsec = (delay - t.tv_sec) * 1E9;
+    for(;;) {
+        /* Clear the screen and go home. */
+        fputs("\e[H\e[2J", stdout);
+        show_all();
+        fflush(stdout);
+        nanosleep(&t, NULL);
+    }
+}